@@ -0,0 +1,62 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> bytes{0};
+
+void *counted_alloc(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+} // namespace
+
+AllocationCount allocation_count()
+{
+    AllocationCount count = {allocations.load(std::memory_order_relaxed),
+                             bytes.load(std::memory_order_relaxed)};
+    return count;
+}
+
+void *operator new(std::size_t size) { return counted_alloc(size); }
+
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
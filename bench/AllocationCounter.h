@@ -0,0 +1,28 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+/**
+ * Counts the calls to the global operator new made anywhere in the process,
+ * including by BIQT and by providers. Linking AllocationCounter.cpp into an
+ * executable replaces the global allocation functions.
+ */
+struct AllocationCount {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+AllocationCount allocation_count();
+
+#endif
@@ -0,0 +1,369 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+// Measures the time and allocations BIQT adds around provider calls. Each
+// scenario is compared against calling the mock provider's provider_eval
+// directly, so the reported overhead is the cost of the plugin boundary:
+// lookup, dispatch, result parsing, statistics and tracing hooks.
+//
+// JNI overhead is not covered here because it requires a JVM; the Java
+// bindings are exercised by the Maven test suite instead.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "BIQT.h"
+#include "Prefetcher.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    unsigned long iterations = 2000;
+    unsigned long providers = 4;
+    unsigned long files = 64;
+    std::string latency = "0";
+    std::string cpu = "0";
+    std::string detections = "1";
+    std::string metrics = "5";
+    std::vector<unsigned int> threads = {1, 2, 4, 8};
+};
+
+struct Measurement {
+    std::string name;
+    unsigned int threads;
+    unsigned long calls;
+    unsigned long providerCalls; /* provider evaluations per call */
+    double seconds;
+    AllocationCount allocs;
+};
+
+void usage()
+{
+    std::cout << "SYNOPSIS\n"
+                 "  biqt-bench [OPTIONS]\n\n"
+                 "OPTIONS\n"
+                 "  --iterations=N    Calls per scenario (default 2000).\n"
+                 "  --providers=N     Mock providers in the modality "
+                 "(default 4).\n"
+                 "  --files=N         Inputs in the file list scenario "
+                 "(default 64).\n"
+                 "  --latency-us=N    Mock provider sleep per call "
+                 "(default 0).\n"
+                 "  --cpu=N           Mock provider busy-loop iterations "
+                 "(default 0).\n"
+                 "  --detections=N    Detections per result (default 1).\n"
+                 "  --metrics=N       Metrics per detection (default 5).\n"
+                 "  --threads=A,B,... Thread counts for the scaling scenario "
+                 "(default 1,2,4,8).\n"
+              << std::endl;
+}
+
+void remove_home(const std::string &home, const Options &options)
+{
+    for (unsigned long i = 0; i < options.providers; i++) {
+        std::string name = "BIQTMock" + std::to_string(i);
+        std::string dir = home + "/providers/" + name;
+        unlink((dir + "/lib" + name + ".so").c_str());
+        unlink((dir + "/descriptor.json").c_str());
+        rmdir(dir.c_str());
+    }
+    for (unsigned long i = 0; i < options.files; i++) {
+        unlink((home + "/inputs/" + std::to_string(i) + ".bin").c_str());
+    }
+    rmdir((home + "/providers").c_str());
+    rmdir((home + "/inputs").c_str());
+    rmdir(home.c_str());
+}
+
+/**
+ * Creates a temporary BIQT_HOME containing the mock providers and inputs.
+ */
+std::string make_home(const Options &options)
+{
+    char templ[] = "/tmp/biqt-bench-XXXXXX";
+    if (!mkdtemp(templ)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    std::string home(templ);
+    mkdir((home + "/providers").c_str(), 0700);
+    mkdir((home + "/inputs").c_str(), 0700);
+    for (unsigned long i = 0; i < options.providers; i++) {
+        std::string name = "BIQTMock" + std::to_string(i);
+        std::string dir = home + "/providers/" + name;
+        mkdir(dir.c_str(), 0700);
+        if (symlink(BIQT_MOCK_LIBRARY, (dir + "/lib" + name + ".so").c_str())) {
+            perror("symlink");
+            remove_home(home, options);
+            exit(1);
+        }
+        std::ofstream desc(dir + "/descriptor.json");
+        desc << "{ \"name\": \"" << name << "\", \"version\": \"1.0\", "
+             << "\"description\": \"Synthetic benchmark provider\", "
+             << "\"sourceLanguage\": \"c++\", \"modality\": \"mock\", "
+             << "\"threadSafe\": true }"
+             << std::endl;
+    }
+    std::string block(4096, 'x');
+    for (unsigned long i = 0; i < options.files; i++) {
+        std::ofstream input(home + "/inputs/" + std::to_string(i) + ".bin",
+                            std::ofstream::binary);
+        input << block;
+    }
+    return home;
+}
+
+/**
+ * Removes the temporary BIQT_HOME when the benchmark returns.
+ */
+class TemporaryHome {
+  public:
+    explicit TemporaryHome(const Options &options)
+        : path(make_home(options)), options(options)
+    {
+    }
+    ~TemporaryHome() { remove_home(this->path, this->options); }
+
+    TemporaryHome(const TemporaryHome &) = delete;
+    TemporaryHome &operator=(const TemporaryHome &) = delete;
+
+    const std::string path;
+
+  private:
+    const Options &options;
+};
+
+template <typename F>
+Measurement measure(const std::string &name, unsigned int threads,
+                    unsigned long calls, unsigned long providerCalls, F body)
+{
+    Measurement m;
+    m.name = name;
+    m.threads = threads;
+    m.calls = calls;
+    m.providerCalls = providerCalls;
+    AllocationCount before = allocation_count();
+    Clock::time_point start = Clock::now();
+    body();
+    m.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    AllocationCount after = allocation_count();
+    m.allocs.allocations = after.allocations - before.allocations;
+    m.allocs.bytes = after.bytes - before.bytes;
+    return m;
+}
+
+void report(const std::vector<Measurement> &results)
+{
+    const Measurement &direct = results.front();
+    double directUs = direct.seconds * 1e6 / direct.calls;
+    double directAllocs =
+        static_cast<double>(direct.allocs.allocations) / direct.calls;
+
+    std::cout << std::left << std::setw(28) << "Scenario" << std::right
+              << std::setw(8) << "Threads" << std::setw(10) << "Calls"
+              << std::setw(12) << "us/call" << std::setw(14) << "overhead us"
+              << std::setw(13) << "allocs/call" << std::setw(13)
+              << "extra allocs" << std::setw(13) << "bytes/call"
+              << std::setw(12) << "calls/sec" << std::endl;
+    for (const auto &m : results) {
+        // With several threads, us/call is the CPU-side cost of one call:
+        // elapsed time multiplied by the number of concurrent callers.
+        double us = m.seconds * 1e6 * m.threads / m.calls;
+        double allocs = static_cast<double>(m.allocs.allocations) / m.calls;
+        std::cout << std::left << std::setw(28) << m.name << std::right
+                  << std::setw(8) << m.threads << std::setw(10) << m.calls
+                  << std::fixed << std::setprecision(2) << std::setw(12) << us
+                  << std::setw(14) << us - directUs * m.providerCalls
+                  << std::setw(13) << allocs << std::setw(13)
+                  << allocs - directAllocs * m.providerCalls
+                  << std::setprecision(0) << std::setw(13)
+                  << static_cast<double>(m.allocs.bytes) / m.calls
+                  << std::setw(12) << m.calls / m.seconds << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"iterations", required_argument, 0, 'n'},
+        {"providers", required_argument, 0, 'p'},
+        {"files", required_argument, 0, 'f'},
+        {"latency-us", required_argument, 0, 'l'},
+        {"cpu", required_argument, 0, 'c'},
+        {"detections", required_argument, 0, 'd'},
+        {"metrics", required_argument, 0, 'm'},
+        {"threads", required_argument, 0, 't'},
+        {0, 0, 0, 0}};
+
+    int c;
+    while ((c = getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        switch (c) {
+        case 'n':
+            options.iterations = strtoul(optarg, nullptr, 10);
+            break;
+        case 'p':
+            options.providers = strtoul(optarg, nullptr, 10);
+            break;
+        case 'f':
+            options.files = strtoul(optarg, nullptr, 10);
+            break;
+        case 'l':
+            options.latency = optarg;
+            break;
+        case 'c':
+            options.cpu = optarg;
+            break;
+        case 'd':
+            options.detections = optarg;
+            break;
+        case 'm':
+            options.metrics = optarg;
+            break;
+        case 't': {
+            options.threads.clear();
+            std::stringstream list(optarg);
+            std::string count;
+            while (getline(list, count, ',')) {
+                options.threads.push_back(
+                    static_cast<unsigned int>(strtoul(count.c_str(), nullptr, 10)));
+            }
+            break;
+        }
+        default:
+            usage();
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (!options.iterations || !options.providers || !options.files) {
+        usage();
+        return 1;
+    }
+
+    setenv("BIQT_MOCK_LATENCY_US", options.latency.c_str(), 1);
+    setenv("BIQT_MOCK_CPU_ITERATIONS", options.cpu.c_str(), 1);
+    setenv("BIQT_MOCK_DETECTIONS", options.detections.c_str(), 1);
+    setenv("BIQT_MOCK_METRICS", options.metrics.c_str(), 1);
+
+    TemporaryHome temporaryHome(options);
+    const std::string &home = temporaryHome.path;
+    setenv("BIQT_HOME", home.c_str(), 1);
+    std::string input = home + "/inputs/0.bin";
+    std::vector<Measurement> results;
+
+    {
+        void *handle = dlopen(BIQT_MOCK_LIBRARY, RTLD_NOW);
+        if (!handle) {
+            std::cerr << "Unable to load " << BIQT_MOCK_LIBRARY << ": "
+                      << dlerror() << std::endl;
+            return 1;
+        }
+        evaluator eval = (evaluator)dlsym(handle, "provider_eval");
+        result_deleter release = (result_deleter)dlsym(handle, "provider_free");
+        results.push_back(measure(
+            "provider_eval (direct)", 1, options.iterations, 1, [&] {
+                for (unsigned long i = 0; i < options.iterations; i++) {
+                    release(eval(input.c_str()));
+                }
+            }));
+        dlclose(handle);
+    }
+
+    BIQT app;
+    if (app.getProviders().size() != options.providers) {
+        std::cerr << "Expected " << options.providers << " mock providers in "
+                  << home << "." << std::endl;
+        return 1;
+    }
+
+    results.push_back(measure("runProvider", 1, options.iterations, 1, [&] {
+        for (unsigned long i = 0; i < options.iterations; i++) {
+            app.runProvider("BIQTMock0", input);
+        }
+    }));
+
+    unsigned long modalityCalls = options.iterations / options.providers;
+    if (!modalityCalls) {
+        modalityCalls = 1;
+    }
+    results.push_back(measure(
+        "runModality (" + std::to_string(options.providers) + " providers)", 1,
+        modalityCalls, options.providers, [&] {
+            for (unsigned long i = 0; i < modalityCalls; i++) {
+                app.runModality("mock", input);
+            }
+        }));
+
+    results.push_back(measure(
+        "file list + prefetch", 1, options.files, options.providers, [&] {
+            Prefetcher prefetcher(64 * 1024 * 1024);
+            for (unsigned long i = 0; i < options.files; i++) {
+                prefetcher.enqueue(home + "/inputs/" + std::to_string(i) +
+                                   ".bin");
+            }
+            for (unsigned long i = 0; i < options.files; i++) {
+                std::string file =
+                    home + "/inputs/" + std::to_string(i) + ".bin";
+                app.runModality("mock", file);
+                prefetcher.release(file);
+            }
+        }));
+
+    for (unsigned int threads : options.threads) {
+        if (!threads) {
+            continue;
+        }
+        unsigned long perThread = options.iterations / threads;
+        if (!perThread) {
+            perThread = 1;
+        }
+        results.push_back(measure(
+            "runProvider (concurrent)", threads, perThread * threads, 1, [&] {
+                std::vector<std::thread> workers;
+                for (unsigned int t = 0; t < threads; t++) {
+                    workers.push_back(std::thread([&app, &input, perThread] {
+                        for (unsigned long i = 0; i < perThread; i++) {
+                            app.runProvider("BIQTMock0", input);
+                        }
+                    }));
+                }
+                for (auto &worker : workers) {
+                    worker.join();
+                }
+            }));
+    }
+
+    std::cout << "Mock provider: latency " << options.latency << " us, cpu "
+              << options.cpu << " iterations, " << options.detections
+              << " detections x " << options.metrics << " metrics"
+              << std::endl
+              << std::endl;
+    report(results);
+    return 0;
+}
@@ -0,0 +1,207 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+// Micro-benchmarks for the code that every evaluation passes through after the
+// provider returns: serializing and parsing the result JSON and writing the
+// CLI output. Results are parameterized by the number of detections and the
+// number of metric keys per detection. Besides time per operation, each
+// benchmark reports heap allocations and bytes allocated per operation.
+
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "AllocationCounter.h"
+#include "ProviderInterface.h"
+#include "ResultWriter.h"
+
+namespace {
+
+/**
+ * Builds a result resembling what a provider returns for one image.
+ *
+ * @param detections The number of QualityResults.
+ * @param keys The number of metrics per QualityResult.
+ */
+Provider::EvaluationResult make_result(int64_t detections, int64_t keys)
+{
+    Provider::EvaluationResult result;
+    result.errorCode = 0;
+    result.provider = "BIQTBench";
+    for (int64_t d = 0; d < detections; d++) {
+        Provider::QualityResult quality;
+        for (int64_t k = 0; k < keys; k++) {
+            quality.metrics["quality_metric_" + std::to_string(k)] =
+                static_cast<float>(d * keys + k) / 7.0f;
+        }
+        quality.features["bounding_box_x"] = static_cast<float>(d);
+        quality.features["bounding_box_y"] = static_cast<float>(d);
+        quality.features["bounding_box_width"] = 64.0f;
+        quality.features["bounding_box_height"] = 64.0f;
+        result.qualityResult.push_back(std::move(quality));
+    }
+    return result;
+}
+
+/**
+ * Reports allocations per iteration between construction and destruction.
+ */
+class AllocationScope {
+
+  public:
+    explicit AllocationScope(benchmark::State &state)
+        : state(state), start(allocation_count())
+    {
+    }
+
+    ~AllocationScope()
+    {
+        AllocationCount end = allocation_count();
+        this->state.counters["allocs/op"] = benchmark::Counter(
+            static_cast<double>(end.allocations - this->start.allocations),
+            benchmark::Counter::kAvgIterations);
+        this->state.counters["bytes/op"] = benchmark::Counter(
+            static_cast<double>(end.bytes - this->start.bytes),
+            benchmark::Counter::kAvgIterations);
+    }
+
+  private:
+    benchmark::State &state;
+    AllocationCount start;
+};
+
+void result_shapes(benchmark::internal::Benchmark *b)
+{
+    b->ArgNames({"detections", "keys"});
+    for (int64_t detections : {1, 10, 100, 500}) {
+        for (int64_t keys : {5, 50, 200}) {
+            b->Args({detections, keys});
+        }
+    }
+}
+
+void BM_SerializeResult(benchmark::State &state)
+{
+    Provider::EvaluationResult result =
+        make_result(state.range(0), state.range(1));
+    {
+        AllocationScope scope(state);
+        for (auto _ : state) {
+            char *serialized = Provider::serializeResult(result);
+            benchmark::DoNotOptimize(serialized);
+            delete[] serialized;
+        }
+    }
+    char *serialized = Provider::serializeResult(result);
+    size_t bytes = strlen(serialized);
+    delete[] serialized;
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+BENCHMARK(BM_SerializeResult)->Apply(result_shapes);
+
+void BM_DeserializeResult(benchmark::State &state)
+{
+    Provider::EvaluationResult result =
+        make_result(state.range(0), state.range(1));
+    char *serialized = Provider::serializeResult(result);
+    size_t bytes = strlen(serialized);
+    {
+        AllocationScope scope(state);
+        for (auto _ : state) {
+            Provider::EvaluationResult parsed =
+                Provider::deserializeResult(serialized);
+            benchmark::DoNotOptimize(parsed);
+        }
+    }
+    delete[] serialized;
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+BENCHMARK(BM_DeserializeResult)->Apply(result_shapes);
+
+void BM_CsvCellPlain(benchmark::State &state)
+{
+    std::string value = "quality_metric_17";
+    AllocationScope scope(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(csv_cell(value));
+    }
+}
+BENCHMARK(BM_CsvCellPlain);
+
+void BM_CsvCellQuoted(benchmark::State &state)
+{
+    std::string value = "/data/images/subject \"17\", session 2.jpg";
+    AllocationScope scope(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(csv_cell(value));
+    }
+}
+BENCHMARK(BM_CsvCellQuoted);
+
+void BM_CsvCellDouble(benchmark::State &state)
+{
+    double value = 0.142857;
+    AllocationScope scope(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(csv_cell(value));
+    }
+}
+BENCHMARK(BM_CsvCellDouble);
+
+void BM_WriteText(benchmark::State &state)
+{
+    Provider::EvaluationResult result =
+        make_result(state.range(0), state.range(1));
+    std::ostringstream output;
+    AllocationScope scope(state);
+    for (auto _ : state) {
+        output.str("");
+        write_text(output, "/data/images/subject_17.jpg", result);
+    }
+}
+BENCHMARK(BM_WriteText)->Apply(result_shapes);
+
+void BM_WriteJson(benchmark::State &state)
+{
+    Provider::EvaluationResult result =
+        make_result(state.range(0), state.range(1));
+    std::ostringstream output;
+    AllocationScope scope(state);
+    for (auto _ : state) {
+        output.str("");
+        write_json(output, "/data/images/subject_17.jpg", result);
+    }
+}
+BENCHMARK(BM_WriteJson)->Apply(result_shapes);
+
+void BM_WriteJsonModality(benchmark::State &state)
+{
+    // Four providers, as produced by runModality().
+    std::map<std::string, Provider::EvaluationResult> results;
+    for (int i = 0; i < 4; i++) {
+        Provider::EvaluationResult result =
+            make_result(state.range(0), state.range(1));
+        result.provider = "BIQTBench" + std::to_string(i);
+        results[result.provider] = std::move(result);
+    }
+    std::ostringstream output;
+    AllocationScope scope(state);
+    for (auto _ : state) {
+        output.str("");
+        write_json(output, "/data/images/subject_17.jpg", results);
+    }
+}
+BENCHMARK(BM_WriteJsonModality)->Apply(result_shapes);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,79 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <BIQTMock.h>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+
+namespace {
+unsigned long setting(const char *name, unsigned long fallback)
+{
+    const char *value = getenv(name);
+    return value ? strtoul(value, nullptr, 10) : fallback;
+}
+} // namespace
+
+BIQTMock::BIQTMock()
+{
+    // The descriptor is written by biqt-bench; only the name is needed here.
+    DescriptorObject["name"] = "BIQTMock";
+}
+
+BIQTMock::~BIQTMock() {}
+
+Provider::EvaluationResult BIQTMock::evaluate(const std::string &file)
+{
+    Provider::EvaluationResult evalResult;
+    evalResult.errorCode = 0;
+    (void)file;
+
+    unsigned long latency = setting("BIQT_MOCK_LATENCY_US", 0);
+    unsigned long iterations = setting("BIQT_MOCK_CPU_ITERATIONS", 0);
+    unsigned long detections = setting("BIQT_MOCK_DETECTIONS", 1);
+    unsigned long metrics = setting("BIQT_MOCK_METRICS", 5);
+
+    if (latency) {
+        std::this_thread::sleep_for(std::chrono::microseconds(latency));
+    }
+    volatile double burn = 1.0;
+    for (unsigned long i = 0; i < iterations; i++) {
+        burn = burn * 1.0000001 + 0.5;
+    }
+
+    for (unsigned long d = 0; d < detections; d++) {
+        Provider::QualityResult qualityResult;
+        for (unsigned long m = 0; m < metrics; m++) {
+            qualityResult.metrics["metric_" + std::to_string(m)] =
+                static_cast<double>(d * metrics + m) / 7.0;
+        }
+        qualityResult.features["bounding_box_x"] = static_cast<double>(d);
+        qualityResult.features["bounding_box_y"] = static_cast<double>(d);
+        evalResult.qualityResult.push_back(std::move(qualityResult));
+    }
+    return evalResult;
+}
+
+DLL_EXPORT const char *provider_eval(const char *cFilePath)
+{
+    // Unlike the template, one instance is reused so that the benchmark does
+    // not measure descriptor parsing.
+    static BIQTMock p;
+    std::string filePath(cFilePath);
+    Provider::EvaluationResult result = p.evaluate(filePath);
+    return Provider::serializeResult(result);
+}
+
+DLL_EXPORT void provider_free(const char *result)
+{
+    delete[] result;
+}
@@ -0,0 +1,37 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef BIQTMOCK_H
+#define BIQTMOCK_H
+
+#include <ProviderInterface.h>
+#include <fstream>
+#include <json/json.h>
+#include <json/value.h>
+
+/**
+ * A synthetic provider used to measure the overhead of the framework. Its
+ * behavior is controlled by environment variables which are read on every
+ * evaluation:
+ *
+ *   BIQT_MOCK_LATENCY_US     Microseconds to sleep (default 0)
+ *   BIQT_MOCK_CPU_ITERATIONS Iterations of a floating point loop (default 0)
+ *   BIQT_MOCK_DETECTIONS     Number of QualityResults returned (default 1)
+ *   BIQT_MOCK_METRICS        Number of metrics per detection (default 5)
+ */
+class BIQTMock : public Provider {
+
+  public:
+    BIQTMock();
+    ~BIQTMock() override;
+    Provider::EvaluationResult evaluate(const std::string &file) override;
+};
+
+#endif
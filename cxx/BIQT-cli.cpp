@@ -8,13 +8,27 @@
 // Copyright 2019 The MITRE Corporation. All Rights Reserved.
 // #######################################################################
 
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
-#include <json/json.h>
+#include <deque>
+#include <iomanip>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 #include "BIQT.h"
+#include "ModalityRouter.h"
+#include "Prefetcher.h"
+#include "ResultManifest.h"
+#include "ResultWriter.h"
+#include "Trace.h"
 
 #ifndef _MSC_VER /* Check for microsoft compiler */
 #include <getopt.h>
@@ -44,15 +58,57 @@ void usage()
                  "COMMANDS\n"
                  "  -m MODALITY|--modality=MODALITY\n"
                  "    Evaluates the given file using all of the providers "
-                 "associated with the given modality.\n\n"
+                 "associated with the given modality. If MODALITY is 'auto', "
+                 "the modality of each input is determined from its header "
+                 "or from --route-rules.\n\n"
                  "  -p PROVIDER|--provider=PROVIDER\n"
                  "    Evaluates the given file using a specific provider.\n\n"
+                 "  -c FILE|--cascade=FILE\n"
+                 "    Evaluates the given file using the staged providers "
+                 "defined in the JSON cascade FILE. Later stages are skipped "
+                 "when a gate of an earlier stage fails.\n\n"
                  "INPUT BEHAVIORS\n"
                  "  -l|--file-list\n"
                  "    Indicates that the file path contains a "
                  "newline-separated list of input file paths (relative the "
                  "working directory). If this is not provided, it is assumed "
-                 "that file should be parsed as-is.\n"
+                 "that file should be parsed as-is.\n\n"
+                 "  --prefetch=COUNT\n"
+                 "    When used with --file-list, reads up to COUNT upcoming "
+                 "input files in the background while the current file is "
+                 "evaluated. By default, no files are read ahead.\n\n"
+                 "  --prefetch-budget=MEGABYTES\n"
+                 "    Limits the total size of the files held by --prefetch. "
+                 "The default is 256.\n\n"
+                 "  --timeout=MILLISECONDS\n"
+                 "    Stops waiting for a provider after the given time and "
+                 "reports a timeout error. Providers may override this limit "
+                 "with a \"timeout\" in their descriptor. By default, there "
+                 "is no limit.\n\n"
+                 "  --stats\n"
+                 "    Prints per-provider latency and CPU time percentiles, "
+                 "peak memory growth, error counts and overall throughput "
+                 "to stderr when the run completes.\n\n"
+                 "  --perf-counters\n"
+                 "    With --stats, also reports the CPU cycles, instructions, "
+                 "cache misses and branch misses of each provider (Linux "
+                 "only). Requires access to perf_event_open.\n\n"
+                 "  --trace=FILE\n"
+                 "    Writes a timeline of provider loading, file reads, "
+                 "evaluations and output writes to FILE in the Chrome "
+                 "trace-event format, which can be opened in Perfetto. The "
+                 "BIQT_TRACE environment variable has the same effect.\n\n"
+                 "  --route-rules=FILE\n"
+                 "    When used with -m auto, assigns modalities using the "
+                 "'PATTERN MODALITY' lines in FILE before inspecting the "
+                 "input. PATTERN may contain * and ? wildcards.\n\n"
+                 "  --incremental=MANIFEST\n"
+                 "    Stores the results of each input in MANIFEST and, on "
+                 "later runs, prints the stored results of inputs whose size, "
+                 "modification time and inode are unchanged instead of "
+                 "evaluating them again. Stored results are only used by the "
+                 "same command with the same provider versions. Inputs which "
+                 "fail are evaluated again on the next run.\n\n"
                  "OUTPUT BEHAVIORS\n"
                  "  -f (json|text)|--output-format=(json|text)\n"
                  "    Controls how output is returned to the user. By default, "
@@ -62,96 +118,11 @@ void usage()
               << std::endl;
 }
 
-std::string csv_cell(const std::string &value)
-{
-    std::string safe = value;
-    if (!safe.empty() &&
-        (safe[0] == '=' || safe[0] == '+' || safe[0] == '-' || safe[0] == '@')) {
-        safe.insert(safe.begin(), '\'');
-    }
-
-    bool quote = safe.find_first_of(",\"\r\n") != std::string::npos;
-    if (!quote) {
-        return safe;
-    }
-
-    std::string escaped = "\"";
-    for (const char c : safe) {
-        if (c == '"') {
-            escaped += "\"\"";
-        }
-        else {
-            escaped += c;
-        }
-    }
-    escaped += "\"";
-    return escaped;
-}
-
-std::string csv_cell(double value)
-{
-    return std::to_string(value);
-}
-
-void write_text(std::ostream &outputStream, const std::string &imageName,
-                const Provider::EvaluationResult &result)
-{
-    // Write header
-    std::string delim = ",";
-    outputStream << "Provider" << delim << "Image" << delim << "Detection"
-                 << delim << "AttributeType" << delim << "Key" << delim
-                 << "Value" << std::endl;
-
-    // Loop through every detection
-    int d = 1;
-    for (const auto &qualityResult : result.qualityResult) {
-        // Metric map
-        for (const auto &metric : qualityResult.metrics) {
-            outputStream << csv_cell(result.provider) << delim
-                         << csv_cell(imageName) << delim << d << delim
-                         << "Metric" << delim << csv_cell(metric.first) << delim
-                         << csv_cell(metric.second) << std::endl;
-        }
-        // Feature map
-        for (const auto &feature : qualityResult.features) {
-            outputStream << csv_cell(result.provider) << delim
-                         << csv_cell(imageName) << delim << d << delim
-                         << "Feature" << delim << csv_cell(feature.first)
-                         << delim << csv_cell(feature.second) << std::endl;
-        }
-        d = d + 1;
-    }
-}
-
-void write_text2(std::ostream &outputStream, const std::string &imageName,
-                 const Provider::EvaluationResult &result)
-{
-    std::string delim = ",";
-    // Loop through every detection
-    int d = 1;
-    for (const auto &qualityResult : result.qualityResult) {
-        // Metric map
-        for (const auto &metric : qualityResult.metrics) {
-            outputStream << csv_cell(result.provider) << delim
-                         << csv_cell(imageName) << delim << d << delim
-                         << "Metric" << delim << csv_cell(metric.first) << delim
-                         << csv_cell(metric.second) << std::endl;
-        }
-        // Feature map
-        for (const auto &feature : qualityResult.features) {
-            outputStream << csv_cell(result.provider) << delim
-                         << csv_cell(imageName) << delim << d << delim
-                         << "Feature" << delim << csv_cell(feature.first)
-                         << delim << csv_cell(feature.second) << std::endl;
-        }
-        d = d + 1;
-    }
-}
-
 void to_text(const std::string &imageName,
              const Provider::EvaluationResult &result,
              const std::string &outputPath)
 {
+    TraceSpan span("write output", "io", imageName);
     // Create the file if it does not exist
     if (outputPath != "-") {
         std::ofstream outputStream(outputPath, std::ofstream::app);
@@ -167,25 +138,15 @@ void to_text2(const std::string &imageName,
               const std::map<std::string, Provider::EvaluationResult> &results,
               const std::string &outputPath)
 {
-    std::string delim = ",";
+    TraceSpan span("write output", "io", imageName);
     // Create the file if it does not exist
     if (outputPath != "-") {
         std::ofstream outputStream(outputPath, std::ofstream::app);
-        outputStream << "Provider" << delim << "Image" << delim << "Detection"
-                     << delim << "AttributeType" << delim << "Key" << delim
-                     << "Value" << std::endl;
-        for (const auto &kv : results) {
-            write_text2(outputStream, imageName, kv.second);
-        }
+        write_text(outputStream, imageName, results);
         outputStream.close();
     }
     else {
-        std::cout << "Provider" << delim << "Image" << delim << "Detection"
-                  << delim << "AttributeType" << delim << "Key" << delim
-                  << "Value" << std::endl;
-        for (const auto &kv : results) {
-            write_text2(std::cout, imageName, kv.second);
-        }
+        write_text(std::cout, imageName, results);
     }
 }
 
@@ -193,34 +154,15 @@ int to_json(const std::string &imageName,
             const Provider::EvaluationResult &result,
             const std::string &outputPath)
 {
-    Json::Value jsonResult;
-    Json::Value vec(Json::arrayValue);
-
-    // Read from module_jsonResult to Json object jsonResult
-    for (const auto &qualityResult : result.qualityResult) {
-        Json::Value dResult;
-
-        for (const auto &metric : qualityResult.metrics) {
-            dResult["metrics"][metric.first] = metric.second;
-        }
-
-        for (const auto &feature : qualityResult.features) {
-            dResult["features"][feature.first] = feature.second;
-        }
-
-        vec.append(std::move(dResult));
-    }
-
-    jsonResult[imageName][result.provider] = std::move(vec);
-
+    TraceSpan span("write output", "io", imageName);
     // Write Json object to file
     if (outputPath != "-") {
         std::ofstream outputStream(outputPath, std::ofstream::app);
-        outputStream << jsonResult << std::endl;
+        write_json(outputStream, imageName, result);
         outputStream.close();
     }
     else {
-        std::cout << jsonResult << std::endl;
+        write_json(std::cout, imageName, result);
     }
     return 0;
 }
@@ -229,49 +171,122 @@ int to_json2(const std::string &imageName,
              const std::map<std::string, Provider::EvaluationResult> &results,
              const std::string &outputPath)
 {
-    Json::Value jsonResult;
-    for (const auto &kv : results) {
-        Provider::EvaluationResult result = kv.second;
-        Json::Value vec(Json::arrayValue);
-
-        // Read from module_jsonResult to Json object jsonResult
-        for (const auto &qualityResult : result.qualityResult) {
-            Json::Value dResult;
-
-            for (const auto &metric : qualityResult.metrics) {
-                dResult["metrics"][metric.first] = metric.second;
-            }
-
-            for (const auto &feature : qualityResult.features) {
-                dResult["features"][feature.first] = feature.second;
-            }
-
-            vec.append(std::move(dResult));
-        }
-
-        jsonResult[imageName][result.provider] = std::move(vec);
-    }
-
+    TraceSpan span("write output", "io", imageName);
     // Write Json object to file
     if (outputPath != "-") {
         std::ofstream outputStream(outputPath, std::ofstream::app);
-        outputStream << jsonResult << std::endl;
+        write_json(outputStream, imageName, results);
         outputStream.close();
     }
     else {
-        std::cout << jsonResult << std::endl;
+        write_json(std::cout, imageName, results);
     }
     return 0;
 }
 
+/**
+ * Prints results which were stored by an earlier run in the form in which
+ * run_provider() or run_cascade() printed them.
+ *
+ * @param single Whether the results are those of a single provider (-p).
+ */
+void write_results(const std::string &imageName,
+                   const std::map<std::string, Provider::EvaluationResult> &results,
+                   bool single, const std::string &outputFile,
+                   const std::string &output_type)
+{
+    if (results.empty()) {
+        return;
+    }
+    if (single) {
+        if (output_type == "json")
+            to_json(imageName, results.begin()->second, outputFile);
+        else
+            to_text(imageName, results.begin()->second, outputFile);
+    }
+    else {
+        if (output_type == "json")
+            to_json2(imageName, results, outputFile);
+        else
+            to_text2(imageName, results, outputFile);
+    }
+}
+
+/**
+ * Runs a cascade on an input and prints the results.
+ *
+ * @param evaluated If not null, receives the printed results.
+ *
+ * @return 0 if every provider of the cascade either ran successfully or was
+ * skipped by a gate, -1 otherwise.
+ */
+int run_cascade(BIQT &app, const Cascade &cascade,
+                const std::string &inputFile, const std::string &outputFile,
+                const std::string &output_type,
+                std::map<std::string, Provider::EvaluationResult> *evaluated =
+                    nullptr)
+{
+    std::map<std::string, std::string> skipped;
+    std::map<std::string, Provider::EvaluationResult> results =
+        app.runModality(cascade, inputFile, &skipped);
+
+    for (const auto &kv : skipped) {
+        std::cerr << "Skipped provider " << kv.first << " for " << inputFile
+                  << ": " << kv.second << "." << std::endl;
+    }
+    if (results.size()) {
+        if (output_type == "json")
+            to_json2(inputFile, results, outputFile);
+        else
+            to_text2(inputFile, results, outputFile);
+    }
+
+    // Providers which failed are neither in the results nor skipped.
+    int status = 0;
+    for (const auto &stage : cascade.stages) {
+        for (const auto &name : stage.providers) {
+            auto reason = skipped.find(name);
+            if (!results.count(name) &&
+                (reason == skipped.end() ||
+                 reason->second == "provider not found")) {
+                status = -1;
+            }
+        }
+    }
+    if (evaluated) {
+        *evaluated = std::move(results);
+    }
+    return status;
+}
+
 int run_provider(BIQT &app, bool modality, const std::string &inputFile,
                  const std::string &outputFile, const std::string &mod_arg,
-                 const std::string &output_type)
+                 const std::string &output_type,
+                 const ModalityRouter *router = nullptr,
+                 std::map<std::string, Provider::EvaluationResult> *evaluated =
+                     nullptr)
 {
     if (modality) {
+        std::string inputModality = mod_arg;
+        if (router) {
+            inputModality = router->classify(inputFile);
+            if (inputModality.empty()) {
+                std::cerr << "Unable to determine the modality of "
+                          << inputFile << "." << std::endl;
+                return -1;
+            }
+        }
+
+        size_t expected = 0;
+        for (const auto provider : app.getProviders()) {
+            if (provider->modality == inputModality) {
+                expected++;
+            }
+        }
+
         // Iterate through map
         std::map<std::string, Provider::EvaluationResult> results =
-            app.runModality(mod_arg, inputFile);
+            app.runModality(inputModality, inputFile);
 
         for (const auto &kv : results) {
             std::string provider = kv.first;
@@ -289,6 +304,13 @@ int run_provider(BIQT &app, bool modality, const std::string &inputFile,
             else
                 to_text2(inputFile, results, outputFile);
         }
+        // Providers which failed are left out of the results.
+        if (!expected || results.size() < expected) {
+            return -1;
+        }
+        if (evaluated) {
+            *evaluated = std::move(results);
+        }
     }
 
     else {
@@ -300,21 +322,184 @@ int run_provider(BIQT &app, bool modality, const std::string &inputFile,
             to_json(inputFile, result, outputFile);
         else
             to_text(inputFile, result, outputFile);
+        if (evaluated) {
+            (*evaluated)[result.provider] = std::move(result);
+        }
     }
 
     return 0;
 }
 
+/**
+ * Describes what produces the results of this command, so that a manifest
+ * written by a different command or by other provider versions is not used.
+ */
+std::string incremental_fingerprint(BIQT &app, char command,
+                                    const std::string &mod_arg,
+                                    const std::string &definition)
+{
+    std::ostringstream fingerprint;
+    fingerprint << "BIQT " << app.version() << '\n'
+                << command << ' ' << mod_arg << '\n';
+    // The cascade or routing rules, whose providers depend on the input.
+    if (!definition.empty()) {
+        std::ifstream file(definition, std::ifstream::binary);
+        if (file && file.peek() != std::ifstream::traits_type::eof()) {
+            fingerprint << file.rdbuf();
+        }
+        fingerprint << '\n';
+    }
+    for (const auto &p : app.getProviders()) {
+        bool used = command == 'p' ? p->name == mod_arg
+                    : command == 'm' && mod_arg != "auto"
+                        ? p->modality == mod_arg
+                        : true;
+        if (used) {
+            fingerprint << p->name << ' ' << p->version << '\n';
+        }
+    }
+    return fingerprint.str();
+}
+
+/**
+ * Parses a non-negative decimal option value.
+ *
+ * @param text The option argument.
+ * @param max The largest accepted value.
+ * @param value Receives the value.
+ *
+ * @return false if the argument is not a number no greater than max.
+ */
+bool parse_count(const char *text, unsigned long max, unsigned long &value)
+{
+    if (!text || !isdigit(static_cast<unsigned char>(*text))) {
+        return false;
+    }
+    errno = 0;
+    char *end = nullptr;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (errno == ERANGE || *end != '\0' || parsed > max) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+void print_latency(std::ostream &out, const std::string &provider,
+                   const std::string &stage, const LatencySummary &s)
+{
+    out << std::left << std::setw(24) << provider << std::setw(12) << stage
+        << std::right << std::fixed << std::setprecision(3);
+    for (uint64_t v : {s.p50, s.p90, s.p99, s.max}) {
+        out << std::setw(12) << v / 1000.0;
+    }
+    out << std::endl;
+}
+
+void print_counters(std::ostream &out, const ProviderStatistics &s)
+{
+    const CounterSample &c = s.counters;
+    // Separates the fields of a line; empty before the first one.
+    const char *separator = "";
+    out << std::left << std::setw(24) << "" << std::fixed
+        << std::setprecision(0);
+    if (c.available & CounterSample::CYCLES) {
+        out << "cycles " << c.cycles / static_cast<double>(s.counted)
+            << "/eval";
+        separator = ", ";
+    }
+    if (c.available & CounterSample::INSTRUCTIONS) {
+        out << separator << "instructions "
+            << c.instructions / static_cast<double>(s.counted) << "/eval";
+        if ((c.available & CounterSample::CYCLES) && c.cycles) {
+            out << std::setprecision(2) << " (IPC "
+                << c.instructions / static_cast<double>(c.cycles) << ")";
+        }
+    }
+    out << std::endl << std::left << std::setw(24) << "";
+    separator = "";
+    double kilo = c.instructions / 1000.0;
+    if (c.available & CounterSample::CACHE_MISSES) {
+        out << std::setprecision(0) << "cache misses "
+            << c.cacheMisses / static_cast<double>(s.counted) << "/eval";
+        if (kilo > 0) {
+            out << std::setprecision(2) << " (" << c.cacheMisses / kilo
+                << " per 1k instructions)";
+        }
+        separator = ", ";
+    }
+    if (c.available & CounterSample::BRANCH_MISSES) {
+        out << std::setprecision(0) << separator << "branch misses "
+            << c.branchMisses / static_cast<double>(s.counted) << "/eval";
+        if (kilo > 0) {
+            out << std::setprecision(2) << " (" << c.branchMisses / kilo
+                << " per 1k instructions)";
+        }
+    }
+    out << std::endl;
+}
+
+void print_statistics(std::ostream &out, const BIQT &app, size_t inputs,
+                      double seconds)
+{
+    out << std::endl
+        << std::left << std::setw(24) << "Provider" << std::setw(12) << "Stage"
+        << std::right << std::setw(12) << "p50 (ms)" << std::setw(12)
+        << "p90 (ms)" << std::setw(12) << "p99 (ms)" << std::setw(12)
+        << "max (ms)" << std::endl;
+    for (const auto &kv : app.getStatistics()) {
+        const ProviderStatistics &s = kv.second;
+        if (!s.evaluations) {
+            continue;
+        }
+        print_latency(out, kv.first, "evaluate", s.evaluate);
+        print_latency(out, "", "queue", s.queueWait);
+        print_latency(out, "", "deserialize", s.deserialize);
+        print_latency(out, "", "cpu", s.cpu);
+        out << std::left << std::setw(24) << "" << s.evaluations
+            << " evaluations, " << s.errors << " errors, " << s.timeouts
+            << " timeouts" << std::endl;
+        out << std::left << std::setw(24) << "" << "peak RSS growth "
+            << s.rssGrowthKb << " KB (max " << s.maxRssGrowthKb
+            << " KB per evaluation)";
+        if (s.workerPeakRssKb) {
+            out << ", worker peak RSS " << s.workerPeakRssKb << " KB";
+        }
+        out << std::endl;
+        if (s.counted) {
+            print_counters(out, s);
+        }
+    }
+    out << std::endl
+        << "Processed " << inputs << " inputs in " << std::setprecision(3)
+        << seconds << " s (" << (seconds > 0 ? inputs / seconds : 0)
+        << " images/sec)." << std::endl;
+}
+
+enum LongOption { OPT_PREFETCH = 256, OPT_PREFETCH_BUDGET, OPT_ROUTE_RULES,
+                  OPT_TIMEOUT, OPT_STATS, OPT_TRACE, OPT_PERF_COUNTERS,
+                  OPT_INCREMENTAL };
+
 int main(int argc, char **argv)
 {
     std::string output_type = "text";
     std::string outputFile = "-";
     std::string inputFile;
     std::string mod_arg;
+    std::string route_rules;
+    std::string incremental;
     bool found_matching_providers = false;
     bool modality_flag = false;
     bool provider_flag = false;
+    bool cascade_flag = false;
     bool file_list_flag = false;
+    size_t prefetch_depth = 0;
+    size_t prefetch_budget = 256;
+    unsigned int timeout = 0;
+    bool stats_flag = false;
+    bool perf_counters_flag = false;
+    size_t inputs = 0;
+    size_t reused = 0;
 
     std::unique_ptr<BIQT> app;
 
@@ -325,13 +510,22 @@ int main(int argc, char **argv)
             {"providers", optional_argument, 0, 'P'},
             {"modality", required_argument, 0, 'm'},
             {"provider", required_argument, 0, 'p'},
+            {"cascade", required_argument, 0, 'c'},
             {"output-format", required_argument, 0, 'f'},
             {"output", required_argument, 0, 'o'},
             {"file-list", no_argument, 0, 'l'},
+            {"prefetch", required_argument, 0, OPT_PREFETCH},
+            {"prefetch-budget", required_argument, 0, OPT_PREFETCH_BUDGET},
+            {"route-rules", required_argument, 0, OPT_ROUTE_RULES},
+            {"timeout", required_argument, 0, OPT_TIMEOUT},
+            {"stats", no_argument, 0, OPT_STATS},
+            {"trace", required_argument, 0, OPT_TRACE},
+            {"perf-counters", no_argument, 0, OPT_PERF_COUNTERS},
+            {"incremental", required_argument, 0, OPT_INCREMENTAL},
             {0, 0, 0, 0}};
 
         int option_index = 0;
-        int c = getopt_long(argc, argv, "f:hlo:VP::m:p:", long_options,
+        int c = getopt_long(argc, argv, "c:f:hlo:VP::m:p:", long_options,
                             &option_index);
 
         if (argc == 1) {
@@ -368,6 +562,58 @@ int main(int argc, char **argv)
             file_list_flag = true;
             break;
         }
+        case OPT_PREFETCH: {
+            unsigned long depth;
+            if (!parse_count(optarg, SIZE_MAX, depth)) {
+                std::cerr << "Invalid --prefetch depth: " << optarg
+                          << std::endl;
+                usage();
+                exit(1);
+            }
+            prefetch_depth = depth;
+            break;
+        }
+        case OPT_PREFETCH_BUDGET: {
+            unsigned long budget;
+            if (!parse_count(optarg, SIZE_MAX / (1024 * 1024), budget)) {
+                std::cerr << "Invalid --prefetch-budget: " << optarg
+                          << std::endl;
+                usage();
+                exit(1);
+            }
+            prefetch_budget = budget;
+            break;
+        }
+        case OPT_ROUTE_RULES: {
+            route_rules = optarg;
+            break;
+        }
+        case OPT_TIMEOUT: {
+            unsigned long milliseconds;
+            if (!parse_count(optarg, UINT_MAX, milliseconds)) {
+                std::cerr << "Invalid --timeout: " << optarg << std::endl;
+                usage();
+                exit(1);
+            }
+            timeout = static_cast<unsigned int>(milliseconds);
+            break;
+        }
+        case OPT_STATS: {
+            stats_flag = true;
+            break;
+        }
+        case OPT_PERF_COUNTERS: {
+            perf_counters_flag = true;
+            break;
+        }
+        case OPT_INCREMENTAL: {
+            incremental = optarg;
+            break;
+        }
+        case OPT_TRACE: {
+            Tracer::instance().start(optarg);
+            break;
+        }
         case 'P': {
             // Correct for optarg if space used
             // https://linux.die.net/man/1/getopt
@@ -441,12 +687,23 @@ int main(int argc, char **argv)
             provider_flag = true;
             break;
         }
+        case 'c': {
+            if (optind >= argc) {
+                std::cout << "Please input a valid cascade file, followed by "
+                             "your desired input image/directory."
+                          << std::endl;
+                break;
+            }
+            mod_arg = optarg;
+            cascade_flag = true;
+            break;
+        }
         }
     }
 
     inputFile = argv[argc - 1];
 
-    if (!modality_flag && !provider_flag) {
+    if (!modality_flag && !provider_flag && !cascade_flag) {
         std::cout << "Invalid arguments detected. Run 'biqt --help' to see "
                      "correct usage."
                   << std::endl;
@@ -456,18 +713,126 @@ int main(int argc, char **argv)
     if (!app) {
         app.reset(new BIQT());
     }
+    app->setTimeout(timeout);
+    if (perf_counters_flag) {
+        app->setHardwareCounters(true);
+    }
 
+    std::unique_ptr<Cascade> cascade;
+    if (cascade_flag) {
+        try {
+            cascade.reset(new Cascade(mod_arg));
+        }
+        catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+    }
+
+    std::unique_ptr<ModalityRouter> router;
+    if (modality_flag && mod_arg == "auto") {
+        router.reset(new ModalityRouter());
+        if (!route_rules.empty()) {
+            try {
+                router->loadRules(route_rules);
+            }
+            catch (const std::runtime_error &e) {
+                std::cerr << e.what() << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    std::unique_ptr<ResultManifest> manifest;
+    if (!incremental.empty()) {
+        char command = cascade ? 'c' : modality_flag ? 'm' : 'p';
+        std::string definition =
+            cascade ? mod_arg : router ? route_rules : std::string();
+        manifest.reset(new ResultManifest(
+            incremental,
+            incremental_fingerprint(*app, command, mod_arg, definition)));
+    }
+
+    // Prints the stored results of an unchanged input, or evaluates it.
+    auto process = [&](const std::string &imageFile,
+                       const ResultManifest::FileState &state) {
+        inputs++;
+        std::map<std::string, Provider::EvaluationResult> results;
+        if (manifest && manifest->lookup(imageFile, state, results)) {
+            write_results(imageFile, results, provider_flag, outputFile,
+                          output_type);
+            reused++;
+            return;
+        }
+        std::map<std::string, Provider::EvaluationResult> *evaluated =
+            manifest ? &results : nullptr;
+        int status =
+            cascade ? run_cascade(*app, *cascade, imageFile, outputFile,
+                                  output_type, evaluated)
+                    : run_provider(*app, modality_flag, imageFile, outputFile,
+                                   mod_arg, output_type, router.get(),
+                                   evaluated);
+        if (manifest && !status) {
+            manifest->store(imageFile, state, results);
+        }
+    };
+    // The state is read before the input is evaluated, so that a change
+    // made during the evaluation is noticed by the next run.
+    auto state_of = [&](const std::string &imageFile) {
+        return manifest ? ResultManifest::FileState::of(imageFile)
+                        : ResultManifest::FileState();
+    };
+
+    auto started = std::chrono::steady_clock::now();
     if (file_list_flag) {
         std::ifstream fileList(inputFile);
         std::string imageFile;
-        while (getline(fileList, imageFile)) {
-            run_provider(*app, modality_flag, imageFile, outputFile, mod_arg,
-                         output_type);
+        std::deque<std::pair<std::string, ResultManifest::FileState>> upcoming;
+        std::unique_ptr<Prefetcher> prefetcher;
+        if (prefetch_depth) {
+            prefetcher.reset(new Prefetcher(prefetch_budget * 1024 * 1024));
+        }
+        while (true) {
+            // Keep the next prefetch_depth inputs queued behind this one.
+            while (upcoming.size() <= prefetch_depth &&
+                   getline(fileList, imageFile)) {
+                ResultManifest::FileState state = state_of(imageFile);
+                // Unchanged inputs are not read.
+                if (prefetcher &&
+                    !(manifest && manifest->isCurrent(imageFile, state))) {
+                    prefetcher->enqueue(imageFile);
+                }
+                upcoming.push_back(std::make_pair(imageFile, state));
+            }
+            if (upcoming.empty()) {
+                break;
+            }
+            imageFile = upcoming.front().first;
+            process(imageFile, upcoming.front().second);
+            upcoming.pop_front();
+            if (prefetcher) {
+                prefetcher->release(imageFile);
+            }
         }
     }
     else {
-        run_provider(*app, modality_flag, inputFile, outputFile, mod_arg,
-                     output_type);
+        process(inputFile, state_of(inputFile));
+    }
+
+    if (manifest && !manifest->commit()) {
+        std::cerr << "Unable to write the manifest " << incremental << "."
+                  << std::endl;
+    }
+
+    if (stats_flag) {
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - started;
+        print_statistics(std::cerr, *app, inputs, elapsed.count());
+        if (manifest) {
+            std::cerr << "Reused stored results for " << reused << " of "
+                      << inputs << " inputs." << std::endl;
+        }
     }
+    Tracer::instance().stop();
     return 0;
 }
@@ -8,16 +8,24 @@
 // Copyright 2019 The MITRE Corporation. All Rights Reserved.
 // #######################################################################
 
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <json/json.h>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <sstream>
 #include <sys/stat.h>
+#include <thread>
 
 #ifdef _WIN32
 #include "windows/dirent.h"
@@ -35,19 +43,66 @@
 #define dlhandle(name) dlopen(name, RTLD_NOLOAD)
 #include <dirent.h>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #define PATHSEP ":"
 #define DIRSEP "/"
 #endif
 
 #include "BIQT.h"
 #include "ProviderInterface.h"
+#include "Trace.h"
 #ifdef BIQT_JAVA_SUPPORT
 #include "java_provider.h"
 #endif
+#ifdef BIQT_PYTHON_SUPPORT
+#include "python_provider.h"
+#endif
+
+namespace {
+/**
+ * Reads an optional boolean from a provider descriptor.
+ *
+ * @throws std::runtime_error if the value is not a boolean.
+ */
+bool readFlag(const Json::Value &desc, const char *key,
+              const std::string &desc_path)
+{
+    const Json::Value &value = desc[key];
+    if (!value.isNull() && !value.isBool()) {
+        throw std::runtime_error("Provider Read error: " + std::string(key) +
+                                 " must be true or false in " + desc_path);
+    }
+    return value.asBool();
+}
+
+/**
+ * Reads an optional non-negative integer from a provider descriptor.
+ *
+ * @throws std::runtime_error if the value is not a non-negative integer.
+ */
+unsigned int readCount(const Json::Value &desc, const char *key,
+                       const std::string &desc_path)
+{
+    const Json::Value &value = desc[key];
+    if (!value.isNull() && !value.isUInt()) {
+        throw std::runtime_error("Provider Read error: " + std::string(key) +
+                                 " must be a non-negative integer in " +
+                                 desc_path);
+    }
+    return value.asUInt();
+}
+}
 
 ProviderInfo::ProviderInfo(std::string modulePath, std::string lib)
 {
+    TraceSpan span("load provider", "provider", lib);
     Json::Value desc;
     this->soPath = modulePath + DIRSEP + "providers" DIRSEP + lib + DIRSEP +
 #if defined(_WIN32)
@@ -81,12 +136,36 @@ ProviderInfo::ProviderInfo(std::string modulePath, std::string lib)
     this->description = std::string((desc["description"]).asString());
     this->modality = std::string((desc["modality"]).asString());
     this->sourceLanguage = std::string((desc["sourceLanguage"]).asString());
+    this->timeout = readCount(desc, "timeout", desc_path);
 #ifdef BIQT_JAVA_SUPPORT
     if (this->sourceLanguage == "java") {
         this->className = std::string((desc["className"]).asString());
+        // Concurrent evaluations use separate provider instances.
+        this->threadSafe = true;
         this->classPath = this->getClassPath(modulePath + "/providers/" + lib);
-    } else {
+        std::vector<std::string> jvmOptions;
+        for (const auto &option : desc["jvmOptions"]) {
+            jvmOptions.push_back(option.asString());
+        }
+        java_provider_register(this->classPath.c_str(), jvmOptions);
+    } else
 #endif
+#ifdef BIQT_PYTHON_SUPPORT
+    if (this->sourceLanguage == "python") {
+        const Json::Value &module = desc.get("module", this->name);
+        if (!module.isString() || module.asString().empty()) {
+            throw std::runtime_error(
+                "Provider Read error: module must be a module name in " +
+                desc_path);
+        }
+        this->threadSafe = readFlag(desc, "threadSafe", desc_path);
+        // The module is imported once and stays loaded between evaluations.
+        python_provider_register(this->name.c_str(),
+                                 (modulePath + "/providers/" + lib).c_str(),
+                                 module.asCString());
+    } else
+#endif
+    {
         if (!this->handle) {
             throw std::runtime_error("Provider Read error: Missing shared object: " + this->soPath);
         }
@@ -96,9 +175,18 @@ ProviderInfo::ProviderInfo(std::string modulePath, std::string lib)
                                  "Unable to locate the provider_eval function");
         }
         this->free_result = (result_deleter)dlsym(this->handle, "provider_free");
-#ifdef BIQT_JAVA_SUPPORT
-    }
+        this->eval_buffer =
+            (buffer_evaluator)dlsym(this->handle, "provider_eval_buffer");
+        this->cancel = (canceller)dlsym(this->handle, "provider_cancel");
+#ifndef _WIN32
+        // Java and Python providers share the JVM or interpreter of this
+        // process and cannot be forked.
+        this->isolated = readFlag(desc, "isolated", desc_path);
 #endif
+        // Each isolated evaluation runs in its own process.
+        this->threadSafe =
+            readFlag(desc, "threadSafe", desc_path) || this->isolated;
+    }
 }
 
 #ifdef BIQT_JAVA_SUPPORT
@@ -178,6 +266,12 @@ const char *ProviderInfo::evaluate(std::string filename) const
         return returnvalue;
     }
     else
+#endif
+#ifdef BIQT_PYTHON_SUPPORT
+    if (this->sourceLanguage == "python") {
+        return Provider::serializeResult(this->evaluateResult(filename));
+    }
+    else
 #endif
     if (this->eval) {
         return this->eval(filename.c_str());
@@ -189,6 +283,70 @@ const char *ProviderInfo::evaluate(std::string filename) const
     }
 }
 
+/**
+ * Evaluates an input which has already been mapped into memory. Providers
+ * which do not export provider_eval_buffer are given the file path instead.
+ *
+ * @param input The mapped input.
+ * @return The serialized result, or nullptr on failure.
+ */
+const char *ProviderInfo::evaluate(const MappedInput &input) const
+{
+    if (this->eval_buffer && input.isMapped()) {
+        return this->eval_buffer(input.path().c_str(), input.data(),
+                                 input.length());
+    }
+    return this->evaluate(input.file());
+}
+
+/**
+ * Determines whether evaluateResult() produces results without a serialized
+ * form, which is the case for Java and Python providers.
+ */
+bool ProviderInfo::parsesResults() const
+{
+    return this->sourceLanguage == "java" || this->sourceLanguage == "python";
+}
+
+/**
+ * Evaluates a file and returns the parsed result.
+ *
+ * @param filename The path to the input file.
+ * @return The result of the provider.
+ */
+Provider::EvaluationResult
+ProviderInfo::evaluateResult(const std::string &filename) const
+{
+#ifdef BIQT_JAVA_SUPPORT
+    if (this->sourceLanguage == "java") {
+        Provider::EvaluationResult result;
+        result.errorCode = 0;
+        if (java_provider_evaluate(filename.c_str(), this->name.c_str(),
+                                   this->className.c_str(),
+                                   this->classPath.c_str(), result)) {
+            std::cerr << "An error occurred indicating a problem with the"
+                         " selected provider: " << this->name << ". Please "
+                         "check with the provider vendor for updates."
+                      << std::endl;
+            return Provider::deserializeResult(nullptr);
+        }
+        return result;
+    }
+#endif
+#ifdef BIQT_PYTHON_SUPPORT
+    if (this->sourceLanguage == "python") {
+        Provider::EvaluationResult result;
+        result.errorCode = 0;
+        python_provider_evaluate(filename.c_str(), this->name.c_str(), result);
+        return result;
+    }
+#endif
+    const char *result_str = this->evaluate(filename);
+    Provider::EvaluationResult result = Provider::deserializeResult(result_str);
+    this->freeResult(result_str);
+    return result;
+}
+
 void ProviderInfo::freeResult(const char *result) const
 {
     if (!result) {
@@ -202,8 +360,197 @@ void ProviderInfo::freeResult(const char *result) const
     }
 }
 
+MappedInput::MappedInput(const std::string &filePath) : filePath(filePath)
+{
+    TraceSpan span("map input", "io", filePath);
+#ifdef _WIN32
+    std::ifstream file(filePath, std::ifstream::binary);
+    if (!file) {
+        return;
+    }
+    this->buffer.assign(std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>());
+    if (!this->buffer.empty()) {
+        this->bytes = this->buffer.data();
+        this->size = this->buffer.size();
+    }
+#else
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *addr = mmap(nullptr, static_cast<size_t>(info.st_size),
+                          PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            this->bytes = static_cast<const unsigned char *>(addr);
+            this->size = static_cast<size_t>(info.st_size);
+        }
+    }
+    // The mapping remains valid after the descriptor is closed.
+    close(fd);
+#endif
+}
+
+/**
+ * Wraps bytes which are already in memory, such as an upload received by a
+ * service, so that providers with a buffer entry point read them without a
+ * file.
+ *
+ * @param data The input bytes. They are not copied and must outlive the
+ * object, unless an owner is given.
+ * @param length The number of bytes.
+ * @param name A name for the input, used in statistics, traces and messages.
+ * @param owner Keeps the bytes alive until its last reference is released,
+ * which may happen on another thread after this object is destroyed.
+ * Without an owner, copy() copies the bytes.
+ */
+MappedInput::MappedInput(const unsigned char *data, size_t length,
+                         const std::string &name,
+                         std::shared_ptr<const void> owner)
+    : filePath(name), bytes(length ? data : nullptr), size(length),
+      memory(true), owner(std::move(owner))
+{
+}
+
+MappedInput::~MappedInput()
+{
+#ifndef _WIN32
+    if (this->bytes && !this->memory && this->buffer.empty()) {
+        munmap(const_cast<unsigned char *>(this->bytes), this->size);
+    }
+#endif
+}
+
+namespace {
+
+/**
+ * Takes ownership of a temporary file, which is removed with the last
+ * reference.
+ */
+std::shared_ptr<const std::string> own_temporary(const std::string &path)
+{
+    return std::shared_ptr<const std::string>(
+        new std::string(path), [](const std::string *owned) {
+            remove(owned->c_str());
+            delete owned;
+        });
+}
+
+} // namespace
+
+/**
+ * Gets a path from which providers without a buffer entry point can read the
+ * input. For an input in memory the bytes are written to a temporary file
+ * the first time. The file is removed with the object, or later if an
+ * evaluation still holds temporaryFile().
+ *
+ * @return The path, or an empty string if the file could not be written.
+ */
+const std::string &MappedInput::file() const
+{
+    static const std::string none;
+    if (!this->memory) {
+        return this->filePath;
+    }
+    std::lock_guard<std::mutex> guard(this->fileLock);
+    if (this->tempPath) {
+        return *this->tempPath;
+    }
+    TraceSpan span("write input", "io", this->filePath);
+#ifdef _WIN32
+    char *name = _tempnam(nullptr, "biqt");
+    if (!name) {
+        return none;
+    }
+    std::string path(name);
+    free(name);
+    std::ofstream out(path, std::ofstream::binary);
+    if (out.write(reinterpret_cast<const char *>(this->bytes), this->size)) {
+        out.close();
+        this->tempPath = own_temporary(path);
+    }
+    else {
+        out.close();
+        remove(path.c_str());
+    }
+#else
+    const char *tmpdir = getenv("TMPDIR");
+    std::string templ = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") +
+                        "/biqt-input-XXXXXX";
+    std::vector<char> path(templ.begin(), templ.end());
+    path.push_back('\0');
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        std::cerr << "Unable to create a temporary file for "
+                  << this->filePath << ": " << strerror(errno) << std::endl;
+        return none;
+    }
+    size_t written = 0;
+    while (written < this->size) {
+        ssize_t n = write(fd, this->bytes + written, this->size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    close(fd);
+    if (written != this->size) {
+        unlink(path.data());
+        return none;
+    }
+    this->tempPath = own_temporary(path.data());
+#endif
+    return this->tempPath ? *this->tempPath : none;
+}
+
+/**
+ * Gets a reference to the temporary file written by file(), which keeps the
+ * file until the reference is released.
+ *
+ * @return The path of the file, or nullptr if none has been written.
+ */
+std::shared_ptr<const std::string> MappedInput::temporaryFile() const
+{
+    std::lock_guard<std::mutex> guard(this->fileLock);
+    return this->tempPath;
+}
+
+/**
+ * Creates an input which does not depend on this one: a file is mapped
+ * again, bytes in memory share their owner, and bytes without an owner are
+ * copied.
+ *
+ * @return A new input owned by the caller.
+ */
+MappedInput *MappedInput::copy() const
+{
+    if (!this->memory) {
+        return new MappedInput(this->filePath);
+    }
+    if (this->owner) {
+        return new MappedInput(this->bytes, this->size, this->filePath,
+                               this->owner);
+    }
+    MappedInput *input = new MappedInput(nullptr, 0, this->filePath);
+    input->buffer.assign(this->bytes, this->bytes + this->size);
+    input->bytes = input->buffer.empty() ? nullptr : input->buffer.data();
+    input->size = input->buffer.size();
+    return input;
+}
+
 BIQT::BIQT()
 {
+    /* Start tracing before the providers are loaded */
+    char *trace_path = getenv("BIQT_TRACE");
+    if (trace_path && *trace_path && !Tracer::instance().enabled()) {
+        Tracer::instance().start(trace_path);
+    }
+
     /* Check default installation paths */
     char *biqt_home = getenv("BIQT_HOME");
 
@@ -230,9 +577,31 @@ BIQT::BIQT()
     this->getProviders();
 }
 
+/**
+ * Waits for pending asynchronous evaluations, then unloads the providers. The
+ * destructor waits for the pool threads to exit, so it must not run on one of
+ * them, for example in the callback of an asynchronous evaluation; see
+ * onWorkerThread().
+ */
 BIQT::~BIQT()
 {
+    if (this->onWorkerThread()) {
+        std::cerr << "A BIQT object cannot be destroyed by one of its own "
+                     "asynchronous evaluations."
+                  << std::endl;
+        std::terminate();
+    }
+    // Finish pending asynchronous evaluations while the providers are loaded.
+    this->pool.reset();
     for (const auto p : this->providers) {
+        // An evaluation which exceeded its time limit may still be running
+        // the provider's code, so the provider cannot be unloaded.
+        if (p->abandoned) {
+            std::cerr << "Provider " << p->name << " is still running "
+                      << p->abandoned << " evaluations which exceeded their "
+                      << "time limit and will not be unloaded." << std::endl;
+            continue;
+        }
         delete p;
     }
 }
@@ -305,6 +674,93 @@ std::vector<ProviderInfo *> BIQT::getProviders()
     return this->providers;
 }
 
+/**
+ * Sets the time limit for evaluations whose provider descriptor does not
+ * specify a "timeout".
+ *
+ * @param milliseconds The time limit, or 0 for no limit.
+ */
+void BIQT::setTimeout(unsigned int milliseconds)
+{
+    this->defaultTimeout = milliseconds;
+}
+
+/**
+ * Sets the number of threads used by batch evaluations. It takes effect
+ * before the first batch is run.
+ *
+ * @param threads The number of threads, or 0 for one per hardware thread.
+ */
+void BIQT::setThreads(unsigned int threads)
+{
+    this->threads = threads;
+}
+
+WorkerPool &BIQT::workers()
+{
+    std::lock_guard<std::mutex> guard(this->poolLock);
+    if (!this->pool) {
+        this->pool.reset(new WorkerPool(this->threads));
+    }
+    return *this->pool;
+}
+
+/**
+ * Determines whether the calling thread runs this object's asynchronous and
+ * batch evaluations. An application which may release the last reference to
+ * a BIQT object from an asynchronous callback should check this and hand the
+ * object to another thread to be destroyed.
+ */
+bool BIQT::onWorkerThread() const
+{
+    std::lock_guard<std::mutex> guard(this->poolLock);
+    return this->pool && this->pool->isWorkerThread();
+}
+
+/**
+ * Enables or disables counting CPU cycles, instructions, cache misses and
+ * branch misses around each provider call. Counts are added to the provider
+ * statistics. Evaluations in isolated worker processes are not counted.
+ *
+ * @param enabled Whether to count hardware events.
+ * @return false if counting was requested but no counter could be opened, in
+ * which case counting stays disabled.
+ */
+bool BIQT::setHardwareCounters(bool enabled)
+{
+    if (enabled && !HardwareCounters::available()) {
+        std::cerr << "WARNING: Hardware performance counters are not "
+                     "available; check kernel.perf_event_paranoid."
+                  << std::endl;
+        this->hardwareCounters = false;
+        return false;
+    }
+    this->hardwareCounters = enabled;
+    return true;
+}
+
+/**
+ * Returns the statistics collected for each provider since the providers were
+ * loaded or since the last call to resetStatistics().
+ *
+ * @return A map from provider name to its statistics.
+ */
+std::map<std::string, ProviderStatistics> BIQT::getStatistics() const
+{
+    std::map<std::string, ProviderStatistics> statistics;
+    for (const auto p : this->providers) {
+        statistics[p->name] = p->stats.snapshot();
+    }
+    return statistics;
+}
+
+void BIQT::resetStatistics()
+{
+    for (const auto p : this->providers) {
+        p->stats.reset();
+    }
+}
+
 /**
  * Gets a single provider by name
  *
@@ -328,12 +784,13 @@ const ProviderInfo *BIQT::getProvider(const std::string &pname)
  * @return The return status of the provider.
  */
 Provider::EvaluationResult BIQT::runProvider(const std::string &pName,
-                                             const std::string &filePath)
+                                             const std::string &filePath,
+                                             unsigned int timeout)
 {
     Provider::EvaluationResult result;
     const ProviderInfo *p = getProvider(pName);
     if (p) {
-        result = this->runProvider(p, filePath);
+        result = this->runProvider(p, filePath, timeout);
     }
     else {
         std::cerr << "Provider '" << pName << "' not found." << std::endl;
@@ -342,14 +799,528 @@ Provider::EvaluationResult BIQT::runProvider(const std::string &pName,
 }
 
 Provider::EvaluationResult BIQT::runProvider(const ProviderInfo *p,
-                                             const std::string &filePath)
+                                             const std::string &filePath,
+                                             unsigned int timeout)
+{
+    return this->evaluateFile(p, filePath, timeout,
+                              std::chrono::steady_clock::now());
+}
+
+/**
+ * Evaluates a file, which is mapped for providers which can evaluate from
+ * memory.
+ *
+ * @param queued When the evaluation was requested, for statistics.
+ */
+Provider::EvaluationResult
+BIQT::evaluateFile(const ProviderInfo *p, const std::string &filePath,
+                   unsigned int timeout,
+                   std::chrono::steady_clock::time_point queued)
+{
+    if (p->eval_buffer) {
+        MappedInput input(filePath);
+        return this->evaluate(p, filePath, &input, timeout, queued);
+    }
+    return this->evaluate(p, filePath, nullptr, timeout, queued);
+}
+
+/**
+ * Runs a provider with the provided name on an input which has already been
+ * mapped or is in memory.
+ *
+ * @param pName The name of the provider to run.
+ * @param input The input. It must outlive the call.
+ *
+ * @return The return status of the provider.
+ */
+Provider::EvaluationResult BIQT::runProvider(const std::string &pName,
+                                             const MappedInput &input,
+                                             unsigned int timeout)
+{
+    const ProviderInfo *p = getProvider(pName);
+    if (!p) {
+        std::cerr << "Provider '" << pName << "' not found." << std::endl;
+        Provider::EvaluationResult result;
+        result.errorCode = Provider::GENERIC_ERROR;
+        result.message = "Provider not found.";
+        return result;
+    }
+    return this->runProvider(p, input, timeout);
+}
+
+/**
+ * Runs a particular provider on an input which has already been mapped.
+ *
+ * @param p The provider to run.
+ * @param input The mapped input. It must outlive the call.
+ *
+ * @return The return status of the provider.
+ */
+Provider::EvaluationResult BIQT::runProvider(const ProviderInfo *p,
+                                             const MappedInput &input,
+                                             unsigned int timeout)
+{
+    return this->evaluate(p, input.path(), &input, timeout,
+                          std::chrono::steady_clock::now());
+}
+
+namespace {
+
+/* The most evaluations of a provider which may still be running after their
+ * time limit expired. Further evaluations fail until some of them return.
+ * An abandoned evaluation of a provider which is not thread safe keeps the
+ * provider claimed, so later evaluations fail at once instead of waiting. */
+const unsigned int MAX_ABANDONED = 16;
+
+unsigned int abandonLimit(const ProviderInfo *p)
+{
+    return p->threadSafe ? MAX_ABANDONED : 1;
+}
+
+/**
+ * Serializes evaluations of providers which are not thread safe. Unlike a
+ * lock, a claim may be released by another thread, so the caller can wait
+ * for the provider before the time limit starts and hand the claim to the
+ * thread which evaluates on its behalf.
+ */
+class Claim {
+  public:
+    /**
+     * Waits until the provider is idle and claims it. Thread-safe providers
+     * are claimed at once.
+     */
+    explicit Claim(const ProviderInfo *p) : p(p)
+    {
+        if (p->threadSafe) {
+            this->held = true;
+            return;
+        }
+        std::unique_lock<std::mutex> guard(p->serial);
+        p->idle.wait(guard, [p] {
+            return !p->busy || p->abandoned >= abandonLimit(p);
+        });
+        if (!p->busy) {
+            p->busy = true;
+            this->held = true;
+        }
+    }
+
+    ~Claim()
+    {
+        if (this->held) {
+            release(this->p);
+        }
+    }
+
+    Claim(const Claim &) = delete;
+    Claim &operator=(const Claim &) = delete;
+
+    /**
+     * Whether the provider was claimed. It is not if an abandoned evaluation
+     * still has it.
+     */
+    bool granted() const { return this->held; }
+
+    /**
+     * Gives up ownership of the claim to a thread which calls release().
+     */
+    void handOff() { this->held = false; }
+
+    static void release(const ProviderInfo *p)
+    {
+        if (p->threadSafe) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(p->serial);
+            p->busy = false;
+        }
+        p->idle.notify_one();
+    }
+
+    /**
+     * Wakes the evaluations waiting for a provider after one was abandoned,
+     * so that they fail instead of waiting for it.
+     */
+    static void abandoned(const ProviderInfo *p)
+    {
+        if (p->threadSafe) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(p->serial);
+        }
+        p->idle.notify_all();
+    }
+
+  private:
+    const ProviderInfo *p;
+    bool held = false;
+};
+
+uint64_t micros(std::chrono::steady_clock::duration d)
 {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+
+/* State shared between a caller and the thread evaluating on its behalf. The
+ * thread keeps its own reference so the state outlives an abandoned call. */
+struct PendingEvaluation {
+    std::mutex lock;
+    std::condition_variable finished;
+    bool done = false;
+    bool abandoned = false;
+    bool hasResult = false;
+    std::string result;
+    Provider::EvaluationResult parsed;
+    std::string filePath;
+    std::unique_ptr<MappedInput> input;
+    std::shared_ptr<const std::string> temporaryFile;
+    ResourceSample before;
+    ResourceSample after;
+    CounterSample counters;
+};
+
+/**
+ * Evaluates on a separate thread and waits until the time limit expires. On
+ * expiry the provider's cancel hook is invoked and the thread is abandoned;
+ * it releases its result when the provider eventually returns. Until then it
+ * is counted in ProviderInfo::abandoned, which keeps the provider loaded.
+ * Providers which parse their own results fill parsed instead of serialized.
+ *
+ * The caller claims the provider first, so that waiting for another
+ * evaluation does not count against the time limit. The thread releases the
+ * claim when the provider returns.
+ *
+ * @return 0 on success, Provider::TIMEOUT_ERROR on expiry, or
+ * Provider::GENERIC_ERROR if the provider returned no result.
+ */
+int evaluateWithDeadline(const ProviderInfo *p, Claim &claim,
+                         const std::string &filePath,
+                         const MappedInput *input, unsigned int timeout,
+                         bool countHardware, std::string &serialized,
+                         Provider::EvaluationResult &parsed)
+{
+    std::shared_ptr<PendingEvaluation> pending(new PendingEvaluation());
+    pending->filePath = filePath;
+    // The caller's input may be released before an abandoned thread
+    // finishes, so the thread maps the file again or holds the owner of
+    // bytes in memory, which are copied only if they have none.
+    if (input && input->isMapped() && p->eval_buffer) {
+        pending->input.reset(input->copy());
+    }
+    // Likewise the temporary file of an input in memory, if filePath is one.
+    else if (input) {
+        pending->temporaryFile = input->temporaryFile();
+    }
+
+    std::thread worker([p, pending, countHardware]() {
+        const char *result_str = nullptr;
+        CounterSample counters;
+        if (countHardware) {
+            HardwareCounters::begin();
+        }
+        ResourceSample before = ResourceSample::now();
+        Provider::EvaluationResult parsed;
+        bool hasParsed = false;
+        try {
+            if (p->parsesResults()) {
+                parsed = p->evaluateResult(pending->filePath);
+                hasParsed = true;
+            }
+            else {
+                result_str = pending->input ? p->evaluate(*pending->input)
+                                            : p->evaluate(pending->filePath);
+            }
+        }
+        catch (...) {
+            result_str = nullptr;
+        }
+        Claim::release(p);
+        ResourceSample after = ResourceSample::now();
+        if (countHardware) {
+            counters = HardwareCounters::end();
+        }
+        std::lock_guard<std::mutex> guard(pending->lock);
+        pending->before = before;
+        pending->after = after;
+        pending->counters = counters;
+        if (hasParsed) {
+            pending->parsed = std::move(parsed);
+            pending->hasResult = true;
+        }
+        else if (result_str) {
+            pending->result = result_str;
+            pending->hasResult = true;
+            p->freeResult(result_str);
+        }
+        pending->done = true;
+        if (pending->abandoned) {
+            // This is the last use of the provider.
+            p->abandoned--;
+        }
+        pending->finished.notify_all();
+    });
+    claim.handOff();
+
+    std::unique_lock<std::mutex> guard(pending->lock);
+    bool done = pending->finished.wait_for(
+        guard, std::chrono::milliseconds(timeout),
+        [&pending] { return pending->done; });
+    if (!done) {
+        pending->abandoned = true;
+        p->abandoned++;
+        guard.unlock();
+        Claim::abandoned(p);
+        if (p->cancel) {
+            p->cancel(filePath.c_str());
+        }
+        worker.detach();
+        return Provider::TIMEOUT_ERROR;
+    }
+    guard.unlock();
+    worker.join();
+    p->stats.recordUsage(pending->before, pending->after);
+    p->stats.recordCounters(pending->counters);
+    if (!pending->hasResult) {
+        return Provider::GENERIC_ERROR;
+    }
+    serialized.swap(pending->result);
+    parsed = std::move(pending->parsed);
+    return 0;
+}
+
+/* The time limit of isolated evaluations for which none is configured. The
+ * child is forked from a process which may run other threads, so it can
+ * deadlock on a lock one of them held and must always be bounded. */
+const unsigned int ISOLATED_TIMEOUT = 60000;
+
+#ifndef _WIN32
+/**
+ * Evaluates in a forked child process which is killed if it exceeds the time
+ * limit, which must not be 0. The child writes the serialized result to a
+ * pipe.
+ *
+ * @return 0 on success, Provider::TIMEOUT_ERROR on expiry, or
+ * Provider::GENERIC_ERROR if the child failed or returned no result.
+ */
+int evaluateIsolated(const ProviderInfo *p, const std::string &filePath,
+                     const MappedInput *input, unsigned int timeout,
+                     std::string &serialized)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return Provider::GENERIC_ERROR;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return Provider::GENERIC_ERROR;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        const char *result_str =
+            input ? p->evaluate(*input) : p->evaluate(filePath);
+        if (!result_str) {
+            _exit(1);
+        }
+        size_t length = strlen(result_str);
+        size_t written = 0;
+        while (written < length) {
+            ssize_t n = write(fds[1], result_str + written, length - written);
+            if (n <= 0) {
+                _exit(1);
+            }
+            written += static_cast<size_t>(n);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout);
+    bool expired = false;
+    char buffer[64 * 1024];
+    while (true) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+            expired = true;
+            break;
+        }
+        struct pollfd readable = {fds[0], POLLIN, 0};
+        int ready = poll(&readable, 1, static_cast<int>(left.count()));
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        ssize_t n = read(fds[0], buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        serialized.append(buffer, static_cast<size_t>(n));
+    }
+    close(fds[0]);
+
+    if (expired) {
+        kill(pid, SIGKILL);
+    }
+    int status = 0;
+    struct rusage usage;
+    pid_t reaped;
+    while ((reaped = wait4(pid, &status, 0, &usage)) < 0 && errno == EINTR) {
+    }
+    if (reaped == pid) {
+        uint64_t cpu = static_cast<uint64_t>(usage.ru_utime.tv_sec +
+                                             usage.ru_stime.tv_sec) *
+                           1000000 +
+                       static_cast<uint64_t>(usage.ru_utime.tv_usec +
+                                             usage.ru_stime.tv_usec);
+#ifdef __APPLE__
+        uint64_t peakRss = static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+#else
+        uint64_t peakRss = static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+        p->stats.recordWorkerUsage(cpu, peakRss);
+    }
+    if (expired) {
+        return Provider::TIMEOUT_ERROR;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "The worker process for provider " << p->name
+                  << " terminated abnormally." << std::endl;
+        return Provider::GENERIC_ERROR;
+    }
+    return 0;
+}
+#else
+int evaluateIsolated(const ProviderInfo *p, const std::string &filePath,
+                     const MappedInput *input, unsigned int timeout,
+                     std::string &serialized)
+{
+    Claim claim(p);
+    Provider::EvaluationResult parsed;
+    return evaluateWithDeadline(p, claim, filePath, input, timeout, false,
+                                serialized, parsed);
+}
+#endif
+
+} // namespace
+
+/**
+ * Evaluates an input with a provider. The time limit is taken from the call,
+ * then the provider descriptor, then setTimeout(), in that order.
+ *
+ * @param p The provider to run.
+ * @param filePath The path to the input file.
+ * @param input The mapped input, or nullptr.
+ * @param timeout The time limit in milliseconds, or 0 to use the default.
+ * @param queued When the evaluation was requested, for statistics. The time
+ * until the provider starts, including waiting for other evaluations of a
+ * provider which is not thread safe, is recorded as queue wait.
+ *
+ * @return The return status of the provider.
+ */
+Provider::EvaluationResult
+BIQT::evaluate(const ProviderInfo *p, const std::string &filePath,
+               const MappedInput *input, unsigned int timeout,
+               std::chrono::steady_clock::time_point queued)
+{
+    typedef std::chrono::steady_clock Clock;
     Provider::EvaluationResult result;
     result.errorCode = 0;
     const char* result_str = NULL;
+    if (!timeout) {
+        timeout = p->timeout ? p->timeout : this->defaultTimeout;
+    }
+    if (!timeout && p->isolated) {
+        timeout = ISOLATED_TIMEOUT;
+    }
+    Clock::time_point started = Clock::now();
+    Clock::time_point evaluated = started;
     try {
-        result_str = p->evaluate(filePath);
-        result = Provider::deserializeResult(result_str);
+        // Providers which can only read files get the path of a temporary
+        // copy of an input in memory. It is written before the evaluation is
+        // handed to another thread or process, so they share one copy.
+        const std::string &source =
+            input && (!p->eval_buffer || p->parsesResults()) ? input->file()
+                                                             : filePath;
+        std::unique_ptr<Claim> claim;
+        if (p->abandoned < abandonLimit(p)) {
+            claim.reset(new Claim(p));
+        }
+        started = Clock::now();
+        evaluated = started;
+        unsigned int abandoned = p->abandoned;
+        if (!claim || !claim->granted()) {
+            result.errorCode = Provider::GENERIC_ERROR;
+            result.message =
+                abandoned <= 1
+                    ? "Provider is still running an evaluation which "
+                      "exceeded its time limit."
+                    : "Provider is still running " +
+                          std::to_string(abandoned) +
+                          " evaluations which exceeded their time limit.";
+        }
+        else if (p->isolated || timeout) {
+            std::string serialized;
+            Provider::EvaluationResult direct;
+            int status;
+            {
+                TraceSpan span(p->name, "evaluate", filePath);
+                status = p->isolated
+                             ? evaluateIsolated(p, source, input, timeout,
+                                                serialized)
+                             : evaluateWithDeadline(p, *claim, source,
+                                                    input, timeout,
+                                                    this->hardwareCounters,
+                                                    serialized, direct);
+            }
+            evaluated = Clock::now();
+            TraceSpan span("deserialize", "serialization", p->name);
+            if (status == Provider::TIMEOUT_ERROR) {
+                result.errorCode = status;
+                result.message = "Provider exceeded its time limit of " +
+                                 std::to_string(timeout) + " ms.";
+            }
+            else if (!status && p->parsesResults()) {
+                result = std::move(direct);
+            }
+            else {
+                result = Provider::deserializeResult(
+                    status ? nullptr : serialized.c_str());
+            }
+        }
+        else {
+            if (this->hardwareCounters) {
+                HardwareCounters::begin();
+            }
+            ResourceSample before = ResourceSample::now();
+            {
+                TraceSpan span(p->name, "evaluate", filePath);
+                if (p->parsesResults()) {
+                    result = p->evaluateResult(source);
+                }
+                else {
+                    result_str =
+                        input ? p->evaluate(*input) : p->evaluate(filePath);
+                }
+            }
+            claim.reset();
+            evaluated = Clock::now();
+            p->stats.recordUsage(before, ResourceSample::now());
+            if (this->hardwareCounters) {
+                p->stats.recordCounters(HardwareCounters::end());
+            }
+            TraceSpan span("deserialize", "serialization", p->name);
+            if (!p->parsesResults()) {
+                result = Provider::deserializeResult(result_str);
+            }
+        }
         result.provider = p->name;
     }
     catch (...) {
@@ -362,7 +1333,20 @@ Provider::EvaluationResult BIQT::runProvider(const ProviderInfo *p,
         p->freeResult(result_str);
     }
 
+    Clock::time_point parsed = Clock::now();
+    if (evaluated == started) {
+        evaluated = parsed;
+    }
+    p->stats.queueWait.record(micros(started - queued));
+    p->stats.evaluate.record(micros(evaluated - started));
+    p->stats.deserialize.record(micros(parsed - evaluated));
+    p->stats.evaluations.fetch_add(1, std::memory_order_relaxed);
+    if (result.errorCode == Provider::TIMEOUT_ERROR) {
+        p->stats.timeouts.fetch_add(1, std::memory_order_relaxed);
+    }
+
     if (result.errorCode != 0) {
+        p->stats.errors.fetch_add(1, std::memory_order_relaxed);
         std::cerr << "There was an error evaluating " << filePath
                   << " for provider " << p->name << ". ";
         std::cerr << "Error code: " << result.errorCode;
@@ -372,14 +1356,64 @@ Provider::EvaluationResult BIQT::runProvider(const ProviderInfo *p,
 }
 
 /**
- * Runs a provider based on modality.
+ * Runs a provider based on modality. When any of the matching providers can
+ * evaluate from memory, the input is mapped once and shared between them.
+ *
+ * @param modality The modality of the provider to run.
+ *
+ * @return The return status of the provider.
+ */
+std::map<std::string, Provider::EvaluationResult>
+BIQT::runModality(const std::string &modality, const std::string &filePath,
+                  unsigned int timeout)
+{
+    return this->evaluateModalityFile(modality, filePath, timeout,
+                                      std::chrono::steady_clock::now());
+}
+
+/**
+ * Runs a provider based on modality using an input which has already been
+ * mapped.
  *
  * @param modality The modality of the provider to run.
+ * @param input The mapped input. It must outlive the call.
  *
  * @return The return status of the provider.
  */
 std::map<std::string, Provider::EvaluationResult>
-BIQT::runModality(const std::string &modality, const std::string &filePath)
+BIQT::runModality(const std::string &modality, const MappedInput &input,
+                  unsigned int timeout)
+{
+    return this->evaluateModality(modality, input.path(), &input, timeout,
+                                  std::chrono::steady_clock::now());
+}
+
+/**
+ * Evaluates a file with the providers of a modality. It is mapped once if
+ * any of them can evaluate from memory.
+ *
+ * @param queued When the evaluation was requested, for statistics.
+ */
+std::map<std::string, Provider::EvaluationResult>
+BIQT::evaluateModalityFile(const std::string &modality,
+                           const std::string &filePath, unsigned int timeout,
+                           std::chrono::steady_clock::time_point queued)
+{
+    for (const auto provider : getProviders()) {
+        if (provider->modality == modality && provider->eval_buffer) {
+            MappedInput input(filePath);
+            return this->evaluateModality(modality, filePath, &input, timeout,
+                                          queued);
+        }
+    }
+    return this->evaluateModality(modality, filePath, nullptr, timeout,
+                                  queued);
+}
+
+std::map<std::string, Provider::EvaluationResult>
+BIQT::evaluateModality(const std::string &modality, const std::string &filePath,
+                       const MappedInput *input, unsigned int timeout,
+                       std::chrono::steady_clock::time_point queued)
 {
     int providerCount = 0;
     std::map<std::string, Provider::EvaluationResult> results;
@@ -387,7 +1421,10 @@ BIQT::runModality(const std::string &modality, const std::string &filePath)
     for (const auto provider : getProviders()) {
         if (provider->modality == modality) {
             providerCount++;
-            result = runProvider(provider, filePath);
+            result = this->evaluate(provider, filePath, input, timeout,
+                                    queued);
+            // Time spent in the providers before this one is not queue wait.
+            queued = std::chrono::steady_clock::now();
             if (!result.errorCode) {
                 results.insert(
                     std::pair<std::string, Provider::EvaluationResult>(
@@ -401,3 +1438,387 @@ BIQT::runModality(const std::string &modality, const std::string &filePath)
     }
     return results;
 }
+
+/**
+ * Loads a cascade definition. A cascade is a JSON object with a list of
+ * stages, each naming the providers to run and the gates which must pass
+ * before the next stage runs, e.g.
+ *
+ *   { "name": "iris-enrollment",
+ *     "stages": [
+ *       { "providers": [ "BIQTContactDetector" ],
+ *         "gates": [ { "provider": "BIQTContactDetector",
+ *                      "metric": "contact_lens", "op": "<", "value": 0.5 } ] },
+ *       { "providers": [ "BIQTIris" ] } ] }
+ *
+ * @param path The path to the cascade definition.
+ *
+ * @throws std::runtime_error if the file cannot be read or does not describe
+ * a cascade.
+ */
+Cascade::Cascade(const std::string &path)
+{
+    Json::Value desc;
+    std::ifstream desc_file(path.c_str(), std::ifstream::binary);
+    if (!desc_file) {
+        throw std::runtime_error("Cascade Read error: Unable to open: " + path);
+    }
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    if (!Json::parseFromStream(builder, desc_file, &desc, &errors)) {
+        errors.erase(errors.find_last_not_of('\n') + 1);
+        throw std::runtime_error("Cascade Read error: Invalid JSON in " + path +
+                                 ": " + errors);
+    }
+    auto invalid = [&path](const std::string &what) {
+        return std::runtime_error("Cascade Read error: " + what + " in " + path);
+    };
+    if (!desc.isObject() || !desc["stages"].isArray()) {
+        throw invalid("Missing stages array");
+    }
+    if (!desc["name"].isNull() && !desc["name"].isString()) {
+        throw invalid("Cascade name is not a string");
+    }
+
+    this->name = desc["name"].asString();
+    for (const auto &stage_json : desc["stages"]) {
+        if (!stage_json.isObject() || !stage_json["providers"].isArray()) {
+            throw invalid("Stage without a providers array");
+        }
+        if (!stage_json["gates"].isNull() && !stage_json["gates"].isArray()) {
+            throw invalid("Stage gates are not an array");
+        }
+        CascadeStage stage;
+        for (const auto &provider : stage_json["providers"]) {
+            if (!provider.isString()) {
+                throw invalid("Provider name is not a string");
+            }
+            stage.providers.push_back(provider.asString());
+        }
+        for (const auto &gate_json : stage_json["gates"]) {
+            if (!gate_json.isObject() || !gate_json["provider"].isString() ||
+                !gate_json["metric"].isString() || !gate_json["op"].isString() ||
+                !gate_json["value"].isNumeric() ||
+                !(gate_json["require"].isNull() ||
+                  gate_json["require"].isString())) {
+                throw invalid("Gate without a provider, metric, op and value");
+            }
+            CascadeGate gate;
+            gate.provider = gate_json["provider"].asString();
+            gate.metric = gate_json["metric"].asString();
+            gate.op = gate_json["op"].asString();
+            gate.value = gate_json["value"].asDouble();
+            std::string require = gate_json.get("require", "all").asString();
+            if (require != "all" && require != "any") {
+                throw invalid("Invalid require '" + require +
+                              "', expected 'all' or 'any'");
+            }
+            gate.requireAll = require == "all";
+            if (gate.op != "<" && gate.op != "<=" && gate.op != ">" &&
+                gate.op != ">=" && gate.op != "==" && gate.op != "!=") {
+                throw invalid("Invalid operator '" + gate.op + "'");
+            }
+            stage.gates.push_back(gate);
+        }
+        if (stage.providers.empty()) {
+            throw invalid("Empty stage");
+        }
+        this->stages.push_back(stage);
+    }
+}
+
+/**
+ * Tests a provider result against this gate.
+ *
+ * @param result The result reported by the gate's provider.
+ * @param reason Receives a description of the failure, if any.
+ * @return true if the gate passes, false otherwise.
+ */
+bool CascadeGate::passes(const Provider::EvaluationResult &result,
+                         std::string &reason) const
+{
+    std::string test = this->provider + "." + this->metric + " " + this->op +
+                       " " + std::to_string(this->value);
+    int matched = 0;
+    int tested = 0;
+    for (const auto &qualityResult : result.qualityResult) {
+        auto metric = qualityResult.metrics.find(this->metric);
+        if (metric == qualityResult.metrics.end()) {
+            continue;
+        }
+        double v = metric->second;
+        bool pass = (this->op == "<" && v < this->value) ||
+                    (this->op == "<=" && v <= this->value) ||
+                    (this->op == ">" && v > this->value) ||
+                    (this->op == ">=" && v >= this->value) ||
+                    (this->op == "==" && v == this->value) ||
+                    (this->op == "!=" && v != this->value);
+        tested++;
+        if (pass) {
+            matched++;
+        }
+        else if (reason.empty()) {
+            reason = "gate " + test + " failed (value " + std::to_string(v) +
+                     ")";
+        }
+    }
+    if (!tested) {
+        reason = "gate " + test + " failed (metric not reported)";
+        return false;
+    }
+    if (this->requireAll ? matched == tested : matched > 0) {
+        reason.clear();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Runs the stages of a cascade in order. When a gate fails, the providers of
+ * all later stages are skipped.
+ *
+ * @param cascade The cascade to run.
+ * @param filePath The path to the input file.
+ * @param skipped If provided, receives the reason each skipped provider was
+ * not run.
+ *
+ * @return The results of the providers which ran successfully.
+ */
+std::map<std::string, Provider::EvaluationResult>
+BIQT::runModality(const Cascade &cascade, const std::string &filePath,
+                  std::map<std::string, std::string> *skipped)
+{
+    std::map<std::string, Provider::EvaluationResult> results;
+    std::map<std::string, Provider::EvaluationResult> evaluated;
+    std::unique_ptr<MappedInput> input;
+    std::string reason;
+
+    for (size_t i = 0; i < cascade.stages.size(); i++) {
+        const CascadeStage &stage = cascade.stages[i];
+        for (const auto &name : stage.providers) {
+            if (!reason.empty()) {
+                if (skipped) {
+                    (*skipped)[name] = reason;
+                }
+                continue;
+            }
+            auto queued = std::chrono::steady_clock::now();
+            const ProviderInfo *p = this->getProvider(name);
+            if (!p) {
+                std::cerr << "Provider '" << name << "' not found."
+                          << std::endl;
+                if (skipped) {
+                    (*skipped)[name] = "provider not found";
+                }
+                continue;
+            }
+            if (p->eval_buffer && !input) {
+                input.reset(new MappedInput(filePath));
+            }
+            Provider::EvaluationResult result =
+                this->evaluate(p, filePath, input.get(), 0, queued);
+            evaluated[name] = result;
+            if (!result.errorCode) {
+                results[name] = result;
+            }
+        }
+        if (!reason.empty()) {
+            continue;
+        }
+        for (const auto &gate : stage.gates) {
+            auto result = evaluated.find(gate.provider);
+            if (result == evaluated.end()) {
+                reason = "gate " + gate.provider + "." + gate.metric +
+                         " failed (provider did not run)";
+            }
+            else if (result->second.errorCode) {
+                reason = "gate " + gate.provider + "." + gate.metric +
+                         " failed (provider error " +
+                         std::to_string(result->second.errorCode) + ")";
+            }
+            else {
+                gate.passes(result->second, reason);
+            }
+            if (!reason.empty()) {
+                reason += " at stage " + std::to_string(i + 1);
+                break;
+            }
+        }
+    }
+    return results;
+}
+
+/**
+ * Runs a provider on several files in parallel. Providers whose descriptor
+ * does not declare them "threadSafe" still evaluate one file at a time.
+ *
+ * @param pName The name of the provider to run.
+ * @param filePaths The paths to the input files.
+ *
+ * @return The results, in the order of filePaths.
+ */
+std::vector<Provider::EvaluationResult>
+BIQT::runProviderBatch(const std::string &pName,
+                       const std::vector<std::string> &filePaths)
+{
+    std::vector<Provider::EvaluationResult> results(filePaths.size());
+    const ProviderInfo *p = this->getProvider(pName);
+    if (!p) {
+        std::cerr << "Provider '" << pName << "' not found." << std::endl;
+        for (auto &result : results) {
+            result.errorCode = Provider::GENERIC_ERROR;
+            result.message = "Provider not found.";
+        }
+        return results;
+    }
+    // Time until a pool thread takes an input is queue wait.
+    auto queued = std::chrono::steady_clock::now();
+    this->workers().parallelFor(filePaths.size(), [&](size_t i) {
+        results[i] = this->evaluateFile(p, filePaths[i], 0, queued);
+    });
+    return results;
+}
+
+/**
+ * Runs the providers of a modality on several files in parallel.
+ *
+ * @param modality The modality of the providers to run.
+ * @param filePaths The paths to the input files.
+ *
+ * @return The results for each file, in the order of filePaths.
+ */
+std::vector<std::map<std::string, Provider::EvaluationResult>>
+BIQT::runModalityBatch(const std::string &modality,
+                       const std::vector<std::string> &filePaths)
+{
+    std::vector<std::map<std::string, Provider::EvaluationResult>> results(
+        filePaths.size());
+    auto queued = std::chrono::steady_clock::now();
+    this->workers().parallelFor(filePaths.size(), [&](size_t i) {
+        results[i] = this->evaluateModalityFile(modality, filePaths[i], 0,
+                                                queued);
+    });
+    return results;
+}
+
+/**
+ * Runs a provider on several inputs, which may be in memory, in parallel.
+ *
+ * @param pName The name of the provider to run.
+ * @param inputs The inputs. They must outlive the call.
+ *
+ * @return The results, in the order of inputs.
+ */
+std::vector<Provider::EvaluationResult>
+BIQT::runProviderBatch(const std::string &pName,
+                       const std::vector<const MappedInput *> &inputs)
+{
+    std::vector<Provider::EvaluationResult> results(inputs.size());
+    const ProviderInfo *p = this->getProvider(pName);
+    if (!p) {
+        std::cerr << "Provider '" << pName << "' not found." << std::endl;
+        for (auto &result : results) {
+            result.errorCode = Provider::GENERIC_ERROR;
+            result.message = "Provider not found.";
+        }
+        return results;
+    }
+    auto queued = std::chrono::steady_clock::now();
+    this->workers().parallelFor(inputs.size(), [&](size_t i) {
+        results[i] =
+            this->evaluate(p, inputs[i]->path(), inputs[i], 0, queued);
+    });
+    return results;
+}
+
+/**
+ * Runs the providers of a modality on several inputs, which may be in memory,
+ * in parallel.
+ *
+ * @param modality The modality of the providers to run.
+ * @param inputs The inputs. They must outlive the call.
+ *
+ * @return The results for each input, in the order of inputs.
+ */
+std::vector<std::map<std::string, Provider::EvaluationResult>>
+BIQT::runModalityBatch(const std::string &modality,
+                       const std::vector<const MappedInput *> &inputs)
+{
+    std::vector<std::map<std::string, Provider::EvaluationResult>> results(
+        inputs.size());
+    auto queued = std::chrono::steady_clock::now();
+    this->workers().parallelFor(inputs.size(), [&](size_t i) {
+        results[i] = this->evaluateModality(modality, inputs[i]->path(),
+                                            inputs[i], 0, queued);
+    });
+    return results;
+}
+
+/**
+ * Runs a provider on a pool thread (see BIQT::setThreads) and passes the
+ * result to a callback on that thread. Evaluations which are still pending
+ * when the BIQT object is destroyed are completed first.
+ *
+ * @param pName The name of the provider to run.
+ * @param filePath The path to the input file.
+ * @param done Receives the result. It must not throw.
+ */
+void BIQT::runProviderAsync(
+    const std::string &pName, const std::string &filePath,
+    std::function<void(const Provider::EvaluationResult &)> done)
+{
+    auto queued = std::chrono::steady_clock::now();
+    this->workers().submit([this, pName, filePath, done, queued]() {
+        Provider::EvaluationResult result;
+        try {
+            const ProviderInfo *p = this->getProvider(pName);
+            if (p) {
+                result = this->evaluateFile(p, filePath, 0, queued);
+            }
+            else {
+                std::cerr << "Provider '" << pName << "' not found."
+                          << std::endl;
+            }
+        }
+        catch (const std::exception &e) {
+            result.errorCode = Provider::GENERIC_ERROR;
+            result.message = e.what();
+        }
+        done(result);
+    });
+}
+
+/**
+ * Runs the providers of a modality on a pool thread and passes the results to
+ * a callback on that thread. done receives an empty map if no provider has
+ * the modality, while failed is called if the providers could not be run.
+ *
+ * @param modality The modality of the providers to run.
+ * @param filePath The path to the input file.
+ * @param done Receives the results. It must not throw.
+ * @param failed Receives a description of the failure. If it is not set,
+ * done receives an empty map instead. It must not throw.
+ */
+void BIQT::runModalityAsync(
+    const std::string &modality, const std::string &filePath,
+    std::function<void(const std::map<std::string, Provider::EvaluationResult> &)>
+        done,
+    std::function<void(const std::string &)> failed)
+{
+    auto queued = std::chrono::steady_clock::now();
+    this->workers().submit([this, modality, filePath, done, failed, queued]() {
+        std::map<std::string, Provider::EvaluationResult> results;
+        try {
+            results = this->evaluateModalityFile(modality, filePath, 0, queued);
+        }
+        catch (const std::exception &e) {
+            std::cerr << "Unable to run modality '" << modality
+                      << "': " << e.what() << std::endl;
+            if (failed) {
+                failed(e.what());
+                return;
+            }
+        }
+        done(results);
+    });
+}
@@ -11,13 +11,21 @@
 #ifndef APPLICATION_H
 #define APPLICATION_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <vector>
 
 #include "ProviderInterface.h"
+#include "Statistics.h"
+#include "WorkerPool.h"
 
 #define __BIQT_VERSION__ BIQT_VERSION
 
@@ -29,13 +37,63 @@
 #endif
 
 typedef const char *(*evaluator)(const char *filePath);
+typedef const char *(*buffer_evaluator)(const char *filePath,
+                                        const unsigned char *data,
+                                        size_t length);
 typedef void (*result_deleter)(const char *result);
+typedef void (*canceller)(const char *filePath);
+
+/**
+ * A read-only, memory-mapped view of an input file. The mapping is created
+ * once and shared by every provider which evaluates the input, and it is
+ * released when the object is destroyed.
+ *
+ * An input may also wrap bytes which are already in memory. Such an input
+ * does not own the bytes, which must outlive it, and it has no file until
+ * file() is called for a provider that can only read files. An owner may be
+ * given which keeps the bytes alive; evaluations which outlive their time
+ * limit then hold the owner instead of a copy of the bytes.
+ */
+class DLL_EXPORT MappedInput {
+  public:
+    explicit MappedInput(const std::string &filePath);
+    MappedInput(const unsigned char *data, size_t length,
+                const std::string &name,
+                std::shared_ptr<const void> owner = nullptr);
+    ~MappedInput();
+
+    MappedInput(const MappedInput &) = delete;
+    MappedInput &operator=(const MappedInput &) = delete;
+
+    const std::string &path() const { return this->filePath; }
+    const unsigned char *data() const { return this->bytes; }
+    size_t length() const { return this->size; }
+    bool isMapped() const { return this->bytes != nullptr; }
+    bool inMemory() const { return this->memory; }
+    const std::string &file() const;
+    std::shared_ptr<const std::string> temporaryFile() const;
+    MappedInput *copy() const;
+
+  private:
+    std::string filePath;
+    const unsigned char *bytes = nullptr;
+    size_t size = 0;
+    bool memory = false;
+    std::shared_ptr<const void> owner; /* Keeps bytes in memory alive */
+    std::vector<unsigned char> buffer;
+    mutable std::mutex fileLock;
+    /* Removed once this and every evaluation using it are done with it */
+    mutable std::shared_ptr<const std::string> tempPath;
+};
 
 class DLL_EXPORT ProviderInfo {
   public:
     ProviderInfo(std::string modulePath, std::string lib);
     ~ProviderInfo();
     const char *evaluate(std::string filename) const;
+    const char *evaluate(const MappedInput &input) const;
+    bool parsesResults() const;
+    Provider::EvaluationResult evaluateResult(const std::string &filename) const;
     void freeResult(const char *result) const;
     std::string name;
     std::string version;
@@ -44,7 +102,20 @@ class DLL_EXPORT ProviderInfo {
     std::string sourceLanguage;
     std::string className;
     evaluator eval = nullptr;
+    buffer_evaluator eval_buffer = nullptr;
     result_deleter free_result = nullptr;
+    canceller cancel = nullptr;
+    unsigned int timeout = 0; /* Time limit in milliseconds, 0 for none */
+    bool isolated = false;    /* Whether to evaluate in a child process */
+    bool threadSafe = false;  /* Whether evaluations may run concurrently */
+    mutable ProviderStats stats;
+    /* Unless threadSafe, one evaluation at a time claims the provider by
+     * setting busy while holding serial, and idle is notified on release */
+    mutable std::mutex serial;
+    mutable std::condition_variable idle;
+    mutable bool busy = false;
+    /* Evaluations still running after their time limit expired */
+    mutable std::atomic<unsigned int> abandoned{0};
 
   private:
 #ifdef BIQT_JAVA_SUPPORT
@@ -55,6 +126,39 @@ class DLL_EXPORT ProviderInfo {
     LIB_HANDLE handle = nullptr;
 };
 
+/**
+ * A threshold test over a metric reported by an earlier stage of a cascade.
+ */
+struct DLL_EXPORT CascadeGate {
+    std::string provider; /* The provider which reports the metric */
+    std::string metric;   /* The name of the metric */
+    std::string op;       /* One of <, <=, >, >=, ==, != */
+    double value = 0;     /* The threshold */
+    bool requireAll = true; /* Whether every detection must pass, or any */
+
+    bool passes(const Provider::EvaluationResult &result,
+                std::string &reason) const;
+};
+
+/**
+ * A group of providers which run together. Later stages only run when every
+ * gate of this stage passes.
+ */
+struct DLL_EXPORT CascadeStage {
+    std::vector<std::string> providers;
+    std::vector<CascadeGate> gates;
+};
+
+/**
+ * An ordered list of provider stages loaded from a JSON definition.
+ */
+class DLL_EXPORT Cascade {
+  public:
+    explicit Cascade(const std::string &path);
+    std::string name;
+    std::vector<CascadeStage> stages;
+};
+
 class DLL_EXPORT BIQT {
 
   public:
@@ -65,17 +169,81 @@ class DLL_EXPORT BIQT {
     std::string modulePath;
 
     std::vector<ProviderInfo *> getProviders();
+    void setTimeout(unsigned int milliseconds);
+    void setThreads(unsigned int threads);
+    bool setHardwareCounters(bool enabled);
+    std::map<std::string, ProviderStatistics> getStatistics() const;
+    void resetStatistics();
+    bool onWorkerThread() const;
     Provider::EvaluationResult runProvider(const std::string &pName,
-                                           const std::string &filePath);
+                                           const std::string &filePath,
+                                           unsigned int timeout = 0);
+    Provider::EvaluationResult runProvider(const ProviderInfo *p,
+                                           const std::string &filePath,
+                                           unsigned int timeout = 0);
     Provider::EvaluationResult runProvider(const ProviderInfo *p,
-                                           const std::string &filePath);
+                                           const MappedInput &input,
+                                           unsigned int timeout = 0);
+    Provider::EvaluationResult runProvider(const std::string &pName,
+                                           const MappedInput &input,
+                                           unsigned int timeout = 0);
+    std::map<std::string, Provider::EvaluationResult>
+    runModality(const std::string &modality, const std::string &filePath,
+                unsigned int timeout = 0);
+    std::map<std::string, Provider::EvaluationResult>
+    runModality(const std::string &modality, const MappedInput &input,
+                unsigned int timeout = 0);
     std::map<std::string, Provider::EvaluationResult>
-    runModality(const std::string &modality, const std::string &filePath);
+    runModality(const Cascade &cascade, const std::string &filePath,
+                std::map<std::string, std::string> *skipped = nullptr);
+    std::vector<Provider::EvaluationResult>
+    runProviderBatch(const std::string &pName,
+                     const std::vector<std::string> &filePaths);
+    std::vector<std::map<std::string, Provider::EvaluationResult>>
+    runModalityBatch(const std::string &modality,
+                     const std::vector<std::string> &filePaths);
+    std::vector<Provider::EvaluationResult>
+    runProviderBatch(const std::string &pName,
+                     const std::vector<const MappedInput *> &inputs);
+    std::vector<std::map<std::string, Provider::EvaluationResult>>
+    runModalityBatch(const std::string &modality,
+                     const std::vector<const MappedInput *> &inputs);
+    void runProviderAsync(
+        const std::string &pName, const std::string &filePath,
+        std::function<void(const Provider::EvaluationResult &)> done);
+    void runModalityAsync(
+        const std::string &modality, const std::string &filePath,
+        std::function<void(
+            const std::map<std::string, Provider::EvaluationResult> &)>
+            done,
+        std::function<void(const std::string &)> failed = nullptr);
     static bool fileExists(const std::string &filename);
 
   private:
 
     const ProviderInfo *getProvider(const std::string &p);
+    Provider::EvaluationResult
+    evaluate(const ProviderInfo *p, const std::string &filePath,
+             const MappedInput *input, unsigned int timeout,
+             std::chrono::steady_clock::time_point queued);
+    Provider::EvaluationResult
+    evaluateFile(const ProviderInfo *p, const std::string &filePath,
+                 unsigned int timeout,
+                 std::chrono::steady_clock::time_point queued);
+    std::map<std::string, Provider::EvaluationResult>
+    evaluateModality(const std::string &modality, const std::string &filePath,
+                     const MappedInput *input, unsigned int timeout,
+                     std::chrono::steady_clock::time_point queued);
+    std::map<std::string, Provider::EvaluationResult>
+    evaluateModalityFile(const std::string &modality,
+                         const std::string &filePath, unsigned int timeout,
+                         std::chrono::steady_clock::time_point queued);
+    WorkerPool &workers();
+    unsigned int defaultTimeout = 0;
+    bool hardwareCounters = false;
+    unsigned int threads = 0;
+    std::unique_ptr<WorkerPool> pool;
+    mutable std::mutex poolLock;
     std::vector<ProviderInfo *> providers;
     std::set<std::string> providerLibs();
 };
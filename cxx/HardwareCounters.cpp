@@ -0,0 +1,140 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "HardwareCounters.h"
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const unsigned int COUNTERS = 4;
+
+const uint64_t EVENTS[COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+/* The perf_event file descriptors of one thread. */
+struct ThreadCounters {
+    int fds[COUNTERS];
+    unsigned int opened = 0;
+
+    ThreadCounters()
+    {
+        for (unsigned int i = 0; i < COUNTERS; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = EVENTS[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            this->fds[i] = static_cast<int>(
+                syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+            if (this->fds[i] >= 0) {
+                this->opened |= 1u << i;
+            }
+        }
+    }
+
+    ~ThreadCounters()
+    {
+        for (int fd : this->fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    /**
+     * Reads a counter, scaling it up if the kernel multiplexed it with other
+     * events for part of the interval.
+     */
+    uint64_t read(unsigned int i) const
+    {
+        uint64_t values[3];
+        if (::read(this->fds[i], values, sizeof(values)) !=
+                static_cast<ssize_t>(sizeof(values)) ||
+            !values[2]) {
+            return 0;
+        }
+        if (values[2] == values[1]) {
+            return values[0];
+        }
+        return static_cast<uint64_t>(static_cast<double>(values[0]) *
+                                     values[1] / values[2]);
+    }
+};
+
+ThreadCounters &counters()
+{
+    static thread_local ThreadCounters threadCounters;
+    return threadCounters;
+}
+
+} // namespace
+
+/**
+ * Determines whether at least one counter can be opened on the calling
+ * thread.
+ */
+bool HardwareCounters::available() { return counters().opened != 0; }
+
+/**
+ * Resets and starts the calling thread's counters.
+ */
+void HardwareCounters::begin()
+{
+    ThreadCounters &c = counters();
+    for (unsigned int i = 0; i < COUNTERS; i++) {
+        if (c.opened & (1u << i)) {
+            ioctl(c.fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(c.fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/**
+ * Stops the calling thread's counters.
+ *
+ * @return The events counted since begin().
+ */
+CounterSample HardwareCounters::end()
+{
+    ThreadCounters &c = counters();
+    CounterSample sample;
+    uint64_t *values[COUNTERS] = {&sample.cycles, &sample.instructions,
+                                  &sample.cacheMisses, &sample.branchMisses};
+    for (unsigned int i = 0; i < COUNTERS; i++) {
+        if (c.opened & (1u << i)) {
+            ioctl(c.fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            *values[i] = c.read(i);
+            sample.available |= 1u << i;
+        }
+    }
+    return sample;
+}
+
+#else
+
+bool HardwareCounters::available() { return false; }
+
+void HardwareCounters::begin() {}
+
+CounterSample HardwareCounters::end() { return CounterSample(); }
+
+#endif
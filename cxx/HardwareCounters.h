@@ -0,0 +1,55 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef HARDWARECOUNTERS_H
+#define HARDWARECOUNTERS_H
+
+#include <cstdint>
+
+#include "ProviderInterface.h"
+
+/**
+ * The hardware events counted on one thread between HardwareCounters::begin()
+ * and HardwareCounters::end(). A counter the processor or kernel did not
+ * provide is reported as zero and its bit in available is clear.
+ */
+struct DLL_EXPORT CounterSample {
+    enum Counter {
+        CYCLES = 1,
+        INSTRUCTIONS = 2,
+        CACHE_MISSES = 4,
+        BRANCH_MISSES = 8
+    };
+
+    unsigned int available = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t branchMisses = 0;
+};
+
+/**
+ * Counts user-space CPU cycles, instructions, cache misses and branch misses
+ * for the calling thread using Linux perf_event_open. Counters are opened the
+ * first time a thread calls begin() and closed when the thread exits.
+ *
+ * On other platforms, or when the kernel refuses access (for example because
+ * of kernel.perf_event_paranoid or a virtual machine without a PMU), samples
+ * are empty and available() returns false.
+ */
+class DLL_EXPORT HardwareCounters {
+
+  public:
+    static bool available();
+    static void begin();
+    static CounterSample end();
+};
+
+#endif
@@ -0,0 +1,36 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * Computes the 64-bit FNV-1a hash of a string. The hash is stable across
+ * runs and platforms, so it may name files and identify stored data.
+ *
+ * @param text The string to hash.
+ * @return The hash as 16 lowercase hexadecimal digits.
+ */
+inline std::string fnv1a(const std::string &text)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return hex;
+}
+
+#endif
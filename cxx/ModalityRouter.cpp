@@ -0,0 +1,277 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "ModalityRouter.h"
+
+namespace {
+
+/* The number of bytes read from each input when sniffing. */
+const size_t SNIFF_LENGTH = 64 * 1024;
+
+struct ImageShape {
+    unsigned long width = 0;
+    unsigned long height = 0;
+    unsigned int channels = 0;
+};
+
+unsigned long be16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+
+unsigned long be32(const unsigned char *p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+           ((unsigned long)p[2] << 8) | p[3];
+}
+
+unsigned long le16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+long le32(const unsigned char *p)
+{
+    return (long)(int)((unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+                       ((unsigned long)p[2] << 16) |
+                       ((unsigned long)p[3] << 24));
+}
+
+bool hasPrefix(const std::string &data, const char *prefix, size_t length)
+{
+    return data.size() >= length && !memcmp(data.data(), prefix, length);
+}
+
+bool pngShape(const unsigned char *d, size_t n, ImageShape &shape)
+{
+    if (n < 26 || memcmp(d, "\x89PNG\r\n\x1a\n", 8) || memcmp(d + 12, "IHDR", 4)) {
+        return false;
+    }
+    shape.width = be32(d + 16);
+    shape.height = be32(d + 20);
+    // Color types 0 and 4 are grayscale (with optional alpha).
+    shape.channels = (d[25] == 0 || d[25] == 4) ? 1 : 3;
+    return true;
+}
+
+bool bmpShape(const unsigned char *d, size_t n, ImageShape &shape)
+{
+    if (n < 30 || d[0] != 'B' || d[1] != 'M') {
+        return false;
+    }
+    long height = le32(d + 22);
+    shape.width = (unsigned long)le32(d + 18);
+    shape.height = (unsigned long)(height < 0 ? -height : height);
+    shape.channels = le16(d + 28) <= 8 ? 1 : 3;
+    return true;
+}
+
+bool jpegShape(const unsigned char *d, size_t n, ImageShape &shape)
+{
+    if (n < 4 || d[0] != 0xFF || d[1] != 0xD8) {
+        return false;
+    }
+    size_t i = 2;
+    while (i + 9 < n) {
+        if (d[i] != 0xFF) {
+            return false;
+        }
+        unsigned char marker = d[i + 1];
+        if (marker == 0xFF) {
+            i++;
+            continue;
+        }
+        // Any start-of-frame marker except DHT (C4), JPG (C8) and DAC (CC).
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+            marker != 0xC8 && marker != 0xCC) {
+            shape.height = be16(d + i + 5);
+            shape.width = be16(d + i + 7);
+            shape.channels = d[i + 9];
+            return true;
+        }
+        i += 2 + be16(d + i + 2);
+    }
+    return false;
+}
+
+bool jp2Shape(const unsigned char *d, size_t n, ImageShape &shape)
+{
+    // A raw JPEG 2000 codestream begins with SOC followed by SIZ.
+    if (n >= 44 && d[0] == 0xFF && d[1] == 0x4F && d[2] == 0xFF &&
+        d[3] == 0x51) {
+        const unsigned char *siz = d + 4;
+        shape.width = be32(siz + 4) - be32(siz + 12);
+        shape.height = be32(siz + 8) - be32(siz + 16);
+        shape.channels = be16(siz + 36);
+        return true;
+    }
+    if (n < 12 || memcmp(d + 4, "jP  \r\n\x87\n", 8)) {
+        return false;
+    }
+    for (size_t i = 12; i + 14 <= n; i++) {
+        if (!memcmp(d + i, "ihdr", 4)) {
+            shape.height = be32(d + i + 4);
+            shape.width = be32(d + i + 8);
+            shape.channels = be16(d + i + 12);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+/**
+ * Adds a routing rule. Rules are tested in the order they were added.
+ *
+ * @param pattern A glob pattern (supporting * and ?) which is matched
+ * against the full path, or against the file name when the pattern contains
+ * no directory separator.
+ * @param modality The modality assigned to matching inputs.
+ */
+void ModalityRouter::addRule(const std::string &pattern,
+                             const std::string &modality)
+{
+    this->rules.push_back(std::make_pair(pattern, modality));
+}
+
+/**
+ * Loads routing rules from a file. Each non-empty line that does not begin
+ * with '#' holds a pattern and a modality separated by whitespace, e.g.
+ *
+ *   *_iris_*.png  iris
+ *   face_*.jpg    face
+ *
+ * @param path The path to the rules file.
+ */
+void ModalityRouter::loadRules(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Routing rules error: Unable to open: " +
+                                 path);
+    }
+    std::string line;
+    while (getline(file, line)) {
+        std::istringstream fields(line);
+        std::string pattern, modality;
+        if (!(fields >> pattern) || pattern[0] == '#') {
+            continue;
+        }
+        if (!(fields >> modality)) {
+            throw std::runtime_error("Routing rules error: Missing modality "
+                                     "for pattern '" + pattern + "' in " +
+                                     path);
+        }
+        this->addRule(pattern, modality);
+    }
+}
+
+/**
+ * Determines the modality of an input.
+ *
+ * @param filePath The path to the input file.
+ * @return The modality, or an empty string if it cannot be determined.
+ */
+std::string ModalityRouter::classify(const std::string &filePath) const
+{
+    size_t sep = filePath.find_last_of("/\\");
+    std::string fileName =
+        sep == std::string::npos ? filePath : filePath.substr(sep + 1);
+    for (const auto &rule : this->rules) {
+        bool bare = rule.first.find_first_of("/\\") == std::string::npos;
+        if (matches(rule.first.c_str(),
+                    bare ? fileName.c_str() : filePath.c_str())) {
+            return rule.second;
+        }
+    }
+    return sniff(filePath);
+}
+
+/**
+ * Matches a path against a glob pattern supporting '*' and '?'.
+ */
+bool ModalityRouter::matches(const char *pattern, const char *path)
+{
+    const char *star = nullptr;
+    const char *resume = nullptr;
+    while (*path) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = path;
+        }
+        else if (*pattern == '?' || *pattern == *path) {
+            pattern++;
+            path++;
+        }
+        else if (star) {
+            pattern = star + 1;
+            path = ++resume;
+        }
+        else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return !*pattern;
+}
+
+/**
+ * Determines the modality of an input from its header.
+ *
+ * @param filePath The path to the input file.
+ * @return "face", "iris" or "finger", or an empty string if the input is not
+ * recognized.
+ */
+std::string ModalityRouter::sniff(const std::string &filePath)
+{
+    std::ifstream file(filePath, std::ifstream::binary);
+    if (!file) {
+        return "";
+    }
+    std::string header(SNIFF_LENGTH, '\0');
+    file.read(&header[0], SNIFF_LENGTH);
+    header.resize(static_cast<size_t>(file.gcount()));
+
+    // ISO/IEC 19794 biometric data interchange records.
+    if (hasPrefix(header, "FAC\0", 4)) {
+        return "face";
+    }
+    if (hasPrefix(header, "IIR\0", 4)) {
+        return "iris";
+    }
+    if (hasPrefix(header, "FIR\0", 4) || hasPrefix(header, "FMR\0", 4)) {
+        return "finger";
+    }
+    // WSQ is only used for fingerprints.
+    if (hasPrefix(header, "\xFF\xA0\xFF\xA8", 4)) {
+        return "finger";
+    }
+
+    const unsigned char *d =
+        reinterpret_cast<const unsigned char *>(header.data());
+    ImageShape shape;
+    if (!pngShape(d, header.size(), shape) &&
+        !bmpShape(d, header.size(), shape) &&
+        !jpegShape(d, header.size(), shape) &&
+        !jp2Shape(d, header.size(), shape)) {
+        return "";
+    }
+    if (shape.channels >= 3) {
+        return "face";
+    }
+    // ISO/IEC 19794-6 iris images are VGA or QVGA grayscale.
+    if ((shape.width == 640 && shape.height == 480) ||
+        (shape.width == 320 && shape.height == 240)) {
+        return "iris";
+    }
+    return "finger";
+}
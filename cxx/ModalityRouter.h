@@ -0,0 +1,43 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef MODALITYROUTER_H
+#define MODALITYROUTER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ProviderInterface.h"
+
+/**
+ * Chooses the modality of an input so that mixed batches can be evaluated in
+ * a single run.
+ *
+ * User-supplied rules are consulted first, in the order they were added.
+ * Otherwise only the first few kilobytes of the file are read: ISO/IEC 19794
+ * record headers and WSQ markers identify the modality directly, and for
+ * ordinary images the dimensions and channel count are used.
+ */
+class DLL_EXPORT ModalityRouter {
+
+  public:
+    void addRule(const std::string &pattern, const std::string &modality);
+    void loadRules(const std::string &path);
+    std::string classify(const std::string &filePath) const;
+
+    static bool matches(const char *pattern, const char *path);
+    static std::string sniff(const std::string &filePath);
+
+  private:
+    std::vector<std::pair<std::string, std::string>> rules;
+};
+
+#endif
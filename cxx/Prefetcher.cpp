@@ -0,0 +1,181 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <algorithm>
+#include <fstream>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Prefetcher.h"
+#include "Trace.h"
+
+Prefetcher::Prefetcher(size_t budgetBytes, unsigned int threads)
+    : budget(budgetBytes)
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        this->workers.push_back(std::thread(&Prefetcher::worker, this));
+    }
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+        this->pending.clear();
+    }
+    this->changed.notify_all();
+    for (auto &t : this->workers) {
+        t.join();
+    }
+}
+
+/**
+ * Schedules a file to be read ahead of its evaluation.
+ *
+ * @param path The path to the input file.
+ */
+void Prefetcher::enqueue(const std::string &path)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->pending.push_back(path);
+    }
+    this->changed.notify_one();
+}
+
+/**
+ * Indicates that a file has been evaluated and its share of the budget may be
+ * reused. Files that were never warmed are simply dropped from the queue.
+ *
+ * @param path The path previously passed to enqueue().
+ */
+void Prefetcher::release(const std::string &path)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        // A path listed twice may be warmed and still queued; the warmed copy
+        // is the one being released.
+        auto held = this->warmed.find(path);
+        if (held == this->warmed.end()) {
+            auto queued =
+                std::find(this->pending.begin(), this->pending.end(), path);
+            if (queued != this->pending.end()) {
+                this->pending.erase(queued);
+            }
+            return;
+        }
+        this->inFlight -= held->second;
+        this->warmed.erase(held);
+    }
+    this->changed.notify_all();
+}
+
+void Prefetcher::worker()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (true) {
+        this->changed.wait(guard, [this] {
+            return this->stopping || !this->pending.empty();
+        });
+        if (this->stopping) {
+            return;
+        }
+
+        std::string path = this->pending.front();
+        guard.unlock();
+        size_t size = fileSize(path);
+        guard.lock();
+
+        // Wait for budget to free up. A single file larger than the budget is
+        // still warmed once nothing else is held so the queue cannot stall.
+        this->changed.wait(guard, [this, size] {
+            return this->stopping || this->inFlight == 0 ||
+                   this->inFlight + size <= this->budget;
+        });
+        if (this->stopping) {
+            return;
+        }
+        // The file may have been evaluated (and released) in the meantime.
+        auto queued = std::find(this->pending.begin(), this->pending.end(), path);
+        if (queued == this->pending.end()) {
+            continue;
+        }
+        this->pending.erase(queued);
+        this->inFlight += size;
+        this->warmed.insert(std::make_pair(path, size));
+
+        guard.unlock();
+        warm(path);
+        guard.lock();
+    }
+}
+
+size_t Prefetcher::fileSize(const std::string &path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return 0;
+    }
+    return static_cast<size_t>(info.st_size);
+}
+
+/**
+ * Pulls a file into the page cache.
+ *
+ * @param path The file to read.
+ * @return The number of bytes requested from the operating system.
+ */
+size_t Prefetcher::warm(const std::string &path)
+{
+    TraceSpan span("prefetch", "io", path);
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+#if defined(__linux__)
+    // Ask the kernel to schedule the read, then block this worker until the
+    // pages are resident so that the budget accounting stays honest.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    if (readahead(fd, 0, size) == 0) {
+        close(fd);
+        return size;
+    }
+#endif
+    // Fall back to reading the file through a scratch buffer.
+    char buffer[64 * 1024];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+    close(fd);
+    return size;
+#else
+    std::ifstream input(path, std::ifstream::binary);
+    char buffer[64 * 1024];
+    size_t size = 0;
+    while (input.read(buffer, sizeof(buffer)) || input.gcount()) {
+        size += static_cast<size_t>(input.gcount());
+    }
+    return size;
+#endif
+}
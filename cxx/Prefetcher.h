@@ -0,0 +1,65 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ProviderInterface.h"
+
+/**
+ * Reads input files ahead of evaluation so that providers find their data in
+ * the page cache instead of waiting on the disk.
+ *
+ * Files are queued with enqueue() in the order they will be evaluated and
+ * warmed by a small pool of background threads. The total size of the files
+ * that have been warmed but not yet released is kept under a byte budget so
+ * that a long file list cannot evict its own inputs before they are used.
+ */
+class DLL_EXPORT Prefetcher {
+
+  public:
+    /**
+     * @param budgetBytes The maximum number of bytes held in flight.
+     * @param threads The number of background reader threads.
+     */
+    Prefetcher(size_t budgetBytes, unsigned int threads = 2);
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher &) = delete;
+    Prefetcher &operator=(const Prefetcher &) = delete;
+
+    void enqueue(const std::string &path);
+    void release(const std::string &path);
+
+  private:
+    void worker();
+    static size_t warm(const std::string &path);
+    static size_t fileSize(const std::string &path);
+
+    size_t budget;
+    size_t inFlight = 0;
+    bool stopping = false;
+    std::deque<std::string> pending;
+    std::multimap<std::string, size_t> warmed;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::thread> workers;
+};
+
+#endif
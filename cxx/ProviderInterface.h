@@ -32,6 +32,12 @@
 class Provider {
 
   public:
+    /* Error codes reported by the framework on behalf of a provider */
+    enum FrameworkError {
+        GENERIC_ERROR = -1, /* The provider failed or returned no result */
+        TIMEOUT_ERROR = -2  /* The provider exceeded its time limit */
+    };
+
     struct QualityResult {
         std::map<std::string, double>
             metrics; /* A map containing the quality metrics */
@@ -137,6 +143,28 @@ class Provider {
      */
     virtual EvaluationResult evaluate(const std::string &file) = 0;
 
+    /**
+     * Runs the provider to evaluate an input which has already been loaded
+     * into memory by the framework. Providers which can decode from memory
+     * should override this method; the default implementation ignores the
+     * buffer and reads the file again.
+     *
+     * @param file The path of the input file.
+     * @param data The contents of the input file. Only valid for the duration
+     * of the call.
+     * @param length The number of bytes in data.
+     *
+     * @return The result of the evaluation.
+     */
+    virtual EvaluationResult evaluateBuffer(const std::string &file,
+                                            const unsigned char *data,
+                                            size_t length)
+    {
+        (void)data;
+        (void)length;
+        return evaluate(file);
+    }
+
     /**
      * Deserializes a JSON char array to populate an EvaluationResult struct
      *
@@ -191,16 +219,15 @@ class Provider {
     }
 
     /**
-     * Serializes an EvaluationResult struct into a JSON char array. delete[]
-     * should be called on the return value to avoid memory leaks
+     * Converts an EvaluationResult struct into the JSON layout used by
+     * serializeResult().
      *
-     * @param result_str The EvaluationResult struct
+     * @param result The EvaluationResult struct
      *
-     * @return The serialized JSON string
+     * @return The JSON value
      */
-    static char *serializeResult(const Provider::EvaluationResult &result)
+    static Json::Value resultToJson(const Provider::EvaluationResult &result)
     {
-        // Write result to JSON format
         Json::Value result_json;
         result_json["errorCode"] = result.errorCode;
         result_json["provider"] = result.provider;
@@ -226,9 +253,21 @@ class Provider {
             vec.append(std::move(quality_result));
         }
         result_json["qualityResult"] = std::move(vec);
+        return result_json;
+    }
 
+    /**
+     * Serializes an EvaluationResult struct into a JSON char array. delete[]
+     * should be called on the return value to avoid memory leaks
+     *
+     * @param result_str The EvaluationResult struct
+     *
+     * @return The serialized JSON string
+     */
+    static char *serializeResult(const Provider::EvaluationResult &result)
+    {
         // Return as string
-        std::string result_str = result_json.toStyledString();
+        std::string result_str = resultToJson(result).toStyledString();
         char *result_cstr = new char[result_str.length() + 1];
         strncpy(result_cstr, result_str.c_str(), result_str.length() + 1);
         return result_cstr;
@@ -253,6 +292,32 @@ extern "C" {
 DLL_EXPORT const char *provider_eval(const char *filePath);
 DLL_EXPORT void provider_free(const char *result);
 
+/**
+ * An optional function to evaluate an input which the framework has already
+ * mapped into memory. When it is exported, BIQT maps each input once and
+ * shares the same read-only pages with every provider that evaluates it.
+ *
+ * @param filePath The path to the input file.
+ * @param data The contents of the input file. The pointer must not be used
+ * after the function returns.
+ * @param length The number of bytes in data.
+ *
+ * @return The return status of the provider.
+ */
+DLL_EXPORT const char *provider_eval_buffer(const char *filePath,
+                                            const unsigned char *data,
+                                            size_t length);
+
+/**
+ * An optional function which asks a running evaluation to stop early. BIQT
+ * calls it from another thread when an evaluation of filePath exceeds its
+ * time limit. The evaluation should return as soon as possible; its result is
+ * discarded.
+ *
+ * @param filePath The path to the input file being evaluated.
+ */
+DLL_EXPORT void provider_cancel(const char *filePath);
+
 #ifdef __cplusplus
 }
 #endif
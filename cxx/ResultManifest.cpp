@@ -0,0 +1,302 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <json/json.h>
+#include <memory>
+#include <sys/stat.h>
+
+#include "Hash.h"
+#include "ResultManifest.h"
+#include "Trace.h"
+
+namespace {
+
+const char *const HEADER = "BIQT-MANIFEST 1";
+
+Json::Value to_json_value(const std::map<std::string, double> &values)
+{
+    Json::Value object(Json::objectValue);
+    for (const auto &value : values) {
+        object[value.first] = value.second;
+    }
+    return object;
+}
+
+void from_json_value(const Json::Value &object,
+                     std::map<std::string, double> &values)
+{
+    for (const auto &name : object.getMemberNames()) {
+        values[name] = object[name].asDouble();
+    }
+}
+
+/**
+ * Serializes results on a single line. Doubles are written with enough
+ * digits to be read back exactly, so stored results print as they did when
+ * they were evaluated.
+ */
+std::string serialize(
+    const std::map<std::string, Provider::EvaluationResult> &results)
+{
+    Json::Value root(Json::objectValue);
+    for (const auto &kv : results) {
+        const Provider::EvaluationResult &result = kv.second;
+        Json::Value value;
+        value["errorCode"] = result.errorCode;
+        value["message"] = result.message;
+        Json::Value qualityResults(Json::arrayValue);
+        for (const auto &quality : result.qualityResult) {
+            Json::Value item;
+            item["metrics"] = to_json_value(quality.metrics);
+            item["features"] = to_json_value(quality.features);
+            qualityResults.append(std::move(item));
+        }
+        value["qualityResult"] = std::move(qualityResults);
+        root[kv.first] = std::move(value);
+    }
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, root);
+}
+
+bool deserialize(const std::string &text,
+                 std::map<std::string, Provider::EvaluationResult> &results)
+{
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    if (!reader->parse(text.data(), text.data() + text.size(), &root,
+                       &errors) ||
+        !root.isObject()) {
+        return false;
+    }
+    for (const auto &name : root.getMemberNames()) {
+        const Json::Value &value = root[name];
+        Provider::EvaluationResult result;
+        result.errorCode = value["errorCode"].asInt();
+        result.provider = name;
+        result.message = value["message"].asString();
+        for (const auto &item : value["qualityResult"]) {
+            Provider::QualityResult quality;
+            from_json_value(item["metrics"], quality.metrics);
+            from_json_value(item["features"], quality.features);
+            result.qualityResult.push_back(std::move(quality));
+        }
+        results[name] = std::move(result);
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * Reads the size, modification time and inode of a file.
+ *
+ * @param path The path to the file.
+ * @return The state, which does not exist if the file cannot be read.
+ */
+ResultManifest::FileState ResultManifest::FileState::of(const std::string &path)
+{
+    FileState state;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return state;
+    }
+    state.exists = true;
+    state.size = static_cast<uint64_t>(info.st_size);
+#if defined(__APPLE__)
+    state.mtime = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 +
+                  info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    state.mtime = static_cast<int64_t>(info.st_mtime) * 1000000000;
+#else
+    state.mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+                  info.st_mtim.tv_nsec;
+#endif
+    state.inode = static_cast<uint64_t>(info.st_ino);
+    return state;
+}
+
+bool ResultManifest::FileState::operator==(const FileState &other) const
+{
+    return this->exists == other.exists && this->size == other.size &&
+           this->mtime == other.mtime && this->inode == other.inode;
+}
+
+/**
+ * Loads the manifest of an earlier run, if there is one, and starts the
+ * manifest of this run.
+ *
+ * @param path The manifest file.
+ * @param fingerprint Describes what produces the results, such as the
+ * command and the versions of the providers it runs. Stored results with a
+ * different fingerprint are not used.
+ */
+ResultManifest::ResultManifest(const std::string &path,
+                               const std::string &fingerprint)
+    : path(path), partialPath(path + ".partial"),
+      fingerprint(fnv1a(fingerprint))
+{
+    TraceSpan span("load manifest", "io", path);
+    std::ifstream input(path, std::ifstream::binary);
+    std::string line;
+    if (input && getline(input, line) && line == HEADER) {
+        while (getline(input, line)) {
+            // The path is last since it is the only field which may contain
+            // a tab.
+            size_t fields[5];
+            size_t start = 0;
+            bool complete = true;
+            for (size_t &field : fields) {
+                field = line.find('\t', start);
+                if (field == std::string::npos) {
+                    complete = false;
+                    break;
+                }
+                start = field + 1;
+            }
+            if (!complete) {
+                continue;
+            }
+            Entry entry;
+            entry.state.exists = true;
+            entry.state.size = strtoull(line.c_str(), nullptr, 10);
+            entry.state.mtime = strtoll(line.c_str() + fields[0] + 1, nullptr, 10);
+            entry.state.inode = strtoull(line.c_str() + fields[1] + 1, nullptr, 10);
+            entry.fingerprint =
+                line.substr(fields[2] + 1, fields[3] - fields[2] - 1);
+            entry.results = line.substr(fields[3] + 1, fields[4] - fields[3] - 1);
+            this->previous[line.substr(fields[4] + 1)] = std::move(entry);
+        }
+    }
+
+    this->next.open(this->partialPath,
+                    std::ofstream::binary | std::ofstream::trunc);
+    if (!this->next) {
+        std::cerr << "Unable to write " << this->partialPath
+                  << "; results will not be stored." << std::endl;
+        return;
+    }
+    this->next << HEADER << '\n';
+}
+
+/**
+ * Discards the entries of a run which was not committed.
+ */
+ResultManifest::~ResultManifest()
+{
+    if (this->next.is_open()) {
+        this->next.close();
+        remove(this->partialPath.c_str());
+    }
+}
+
+/**
+ * Determines whether the stored results of an input may be used.
+ *
+ * @param input The path of the input, as given to store().
+ * @param state The current state of the input.
+ */
+bool ResultManifest::isCurrent(const std::string &input,
+                               const FileState &state) const
+{
+    if (!state.exists) {
+        return false;
+    }
+    auto entry = this->previous.find(input);
+    return entry != this->previous.end() &&
+           entry->second.fingerprint == this->fingerprint &&
+           entry->second.state == state;
+}
+
+/**
+ * Gets the stored results of an unchanged input and carries them over to
+ * the manifest of this run.
+ *
+ * @param input The path of the input.
+ * @param state The current state of the input.
+ * @param results Receives the results, keyed by provider name.
+ *
+ * @return true if stored results were found.
+ */
+bool ResultManifest::lookup(
+    const std::string &input, const FileState &state,
+    std::map<std::string, Provider::EvaluationResult> &results)
+{
+    if (!this->isCurrent(input, state)) {
+        return false;
+    }
+    const Entry &entry = this->previous.at(input);
+    if (!deserialize(entry.results, results)) {
+        results.clear();
+        return false;
+    }
+    this->write(input, state, entry.results);
+    return true;
+}
+
+/**
+ * Records the results of an input for the next run. An input without
+ * results is evaluated again instead.
+ *
+ * @param input The path of the input.
+ * @param state The state of the input before it was evaluated.
+ * @param results The results, keyed by provider name.
+ */
+void ResultManifest::store(
+    const std::string &input, const FileState &state,
+    const std::map<std::string, Provider::EvaluationResult> &results)
+{
+    if (!state.exists || results.empty() ||
+        input.find('\n') != std::string::npos) {
+        return;
+    }
+    this->write(input, state, serialize(results));
+}
+
+void ResultManifest::write(const std::string &input, const FileState &state,
+                           const std::string &results)
+{
+    if (!this->next.is_open()) {
+        return;
+    }
+    this->next << state.size << '\t' << state.mtime << '\t' << state.inode
+               << '\t' << this->fingerprint << '\t' << results << '\t'
+               << input << '\n';
+}
+
+/**
+ * Replaces the manifest with the entries of this run.
+ *
+ * @return false if the manifest could not be written.
+ */
+bool ResultManifest::commit()
+{
+    if (!this->next.is_open()) {
+        return false;
+    }
+    this->next.close();
+    if (!this->next) {
+        remove(this->partialPath.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    remove(this->path.c_str());
+#endif
+    if (rename(this->partialPath.c_str(), this->path.c_str()) != 0) {
+        remove(this->partialPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef RESULTMANIFEST_H
+#define RESULTMANIFEST_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "ProviderInterface.h"
+
+/**
+ * Stores the results of a run so that a later run can skip inputs which have
+ * not changed. An input is unchanged when its size, modification time and
+ * inode match the stored ones and it was evaluated by the same command with
+ * the same provider versions, which the caller describes with a fingerprint.
+ *
+ * The manifest is a text file with a header line followed by one line per
+ * input:
+ *
+ *   size TAB mtime TAB inode TAB fingerprint TAB results TAB path
+ *
+ * where results is a single-line JSON object keyed by provider name. The
+ * entries of a run are written to MANIFEST.partial as it goes and replace
+ * the manifest on commit(), so an interrupted run leaves the previous
+ * manifest intact. Inputs which are not part of the run are dropped.
+ */
+class DLL_EXPORT ResultManifest {
+  public:
+    /**
+     * Identifies the contents of a file without reading it.
+     */
+    struct DLL_EXPORT FileState {
+        bool exists = false;
+        uint64_t size = 0;
+        int64_t mtime = 0; /* Nanoseconds since the epoch */
+        uint64_t inode = 0;
+
+        static FileState of(const std::string &path);
+        bool operator==(const FileState &other) const;
+    };
+
+    ResultManifest(const std::string &path, const std::string &fingerprint);
+    ~ResultManifest();
+
+    ResultManifest(const ResultManifest &) = delete;
+    ResultManifest &operator=(const ResultManifest &) = delete;
+
+    bool isCurrent(const std::string &input, const FileState &state) const;
+    bool lookup(const std::string &input, const FileState &state,
+                std::map<std::string, Provider::EvaluationResult> &results);
+    void store(const std::string &input, const FileState &state,
+               const std::map<std::string, Provider::EvaluationResult> &results);
+    bool commit();
+
+  private:
+    struct Entry {
+        FileState state;
+        std::string fingerprint;
+        std::string results;
+    };
+
+    void write(const std::string &input, const FileState &state,
+               const std::string &results);
+
+    std::string path;
+    std::string partialPath;
+    std::string fingerprint;
+    std::unordered_map<std::string, Entry> previous;
+    std::ofstream next;
+};
+
+#endif
@@ -0,0 +1,131 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <json/json.h>
+
+#include "ResultWriter.h"
+
+namespace {
+
+void write_header(std::ostream &outputStream)
+{
+    std::string delim = ",";
+    outputStream << "Provider" << delim << "Image" << delim << "Detection"
+                 << delim << "AttributeType" << delim << "Key" << delim
+                 << "Value" << std::endl;
+}
+
+Json::Value to_json_value(const Provider::EvaluationResult &result)
+{
+    Json::Value vec(Json::arrayValue);
+    for (const auto &qualityResult : result.qualityResult) {
+        Json::Value dResult;
+
+        for (const auto &metric : qualityResult.metrics) {
+            dResult["metrics"][metric.first] = metric.second;
+        }
+
+        for (const auto &feature : qualityResult.features) {
+            dResult["features"][feature.first] = feature.second;
+        }
+
+        vec.append(std::move(dResult));
+    }
+    return vec;
+}
+
+} // namespace
+
+std::string csv_cell(const std::string &value)
+{
+    std::string safe = value;
+    if (!safe.empty() &&
+        (safe[0] == '=' || safe[0] == '+' || safe[0] == '-' || safe[0] == '@')) {
+        safe.insert(safe.begin(), '\'');
+    }
+
+    bool quote = safe.find_first_of(",\"\r\n") != std::string::npos;
+    if (!quote) {
+        return safe;
+    }
+
+    std::string escaped = "\"";
+    for (const char c : safe) {
+        if (c == '"') {
+            escaped += "\"\"";
+        }
+        else {
+            escaped += c;
+        }
+    }
+    escaped += "\"";
+    return escaped;
+}
+
+std::string csv_cell(double value)
+{
+    return std::to_string(value);
+}
+
+void write_text(std::ostream &outputStream, const std::string &imageName,
+                const Provider::EvaluationResult &result, bool header)
+{
+    if (header) {
+        write_header(outputStream);
+    }
+
+    std::string delim = ",";
+    // Loop through every detection
+    int d = 1;
+    for (const auto &qualityResult : result.qualityResult) {
+        // Metric map
+        for (const auto &metric : qualityResult.metrics) {
+            outputStream << csv_cell(result.provider) << delim
+                         << csv_cell(imageName) << delim << d << delim
+                         << "Metric" << delim << csv_cell(metric.first) << delim
+                         << csv_cell(metric.second) << std::endl;
+        }
+        // Feature map
+        for (const auto &feature : qualityResult.features) {
+            outputStream << csv_cell(result.provider) << delim
+                         << csv_cell(imageName) << delim << d << delim
+                         << "Feature" << delim << csv_cell(feature.first)
+                         << delim << csv_cell(feature.second) << std::endl;
+        }
+        d = d + 1;
+    }
+}
+
+void write_text(std::ostream &outputStream, const std::string &imageName,
+                const std::map<std::string, Provider::EvaluationResult> &results)
+{
+    write_header(outputStream);
+    for (const auto &kv : results) {
+        write_text(outputStream, imageName, kv.second, false);
+    }
+}
+
+void write_json(std::ostream &outputStream, const std::string &imageName,
+                const Provider::EvaluationResult &result)
+{
+    Json::Value jsonResult;
+    jsonResult[imageName][result.provider] = to_json_value(result);
+    outputStream << jsonResult << std::endl;
+}
+
+void write_json(std::ostream &outputStream, const std::string &imageName,
+                const std::map<std::string, Provider::EvaluationResult> &results)
+{
+    Json::Value jsonResult;
+    for (const auto &kv : results) {
+        jsonResult[imageName][kv.second.provider] = to_json_value(kv.second);
+    }
+    outputStream << jsonResult << std::endl;
+}
@@ -0,0 +1,62 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "ProviderInterface.h"
+
+/**
+ * Escapes a value for use as a CSV cell. Values which a spreadsheet would
+ * interpret as a formula are prefixed with a single quote.
+ */
+DLL_EXPORT std::string csv_cell(const std::string &value);
+DLL_EXPORT std::string csv_cell(double value);
+
+/**
+ * Writes a result as CSV rows of Provider, Image, Detection, AttributeType,
+ * Key and Value.
+ *
+ * @param outputStream The stream to write to.
+ * @param imageName The name of the evaluated image.
+ * @param result The result to write.
+ * @param header Whether to write the column names first.
+ */
+DLL_EXPORT void write_text(std::ostream &outputStream,
+                           const std::string &imageName,
+                           const Provider::EvaluationResult &result,
+                           bool header = true);
+
+/**
+ * Writes the results of several providers as CSV under a single header.
+ */
+DLL_EXPORT void
+write_text(std::ostream &outputStream, const std::string &imageName,
+           const std::map<std::string, Provider::EvaluationResult> &results);
+
+/**
+ * Writes a result as a JSON object keyed by image name and provider name.
+ */
+DLL_EXPORT void write_json(std::ostream &outputStream,
+                           const std::string &imageName,
+                           const Provider::EvaluationResult &result);
+
+/**
+ * Writes the results of several providers as a single JSON object.
+ */
+DLL_EXPORT void
+write_json(std::ostream &outputStream, const std::string &imageName,
+           const std::map<std::string, Provider::EvaluationResult> &results);
+
+#endif
@@ -0,0 +1,245 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <ctime>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "Statistics.h"
+
+namespace {
+void storeMax(std::atomic<uint64_t> &target, uint64_t value)
+{
+    uint64_t seen = target.load(std::memory_order_relaxed);
+    while (value > seen &&
+           !target.compare_exchange_weak(seen, value,
+                                         std::memory_order_relaxed)) {
+    }
+}
+} // namespace
+
+LatencyHistogram::LatencyHistogram() { this->reset(); }
+
+/**
+ * Records a single duration.
+ *
+ * @param micros The duration in microseconds.
+ */
+void LatencyHistogram::record(uint64_t micros)
+{
+    this->counts[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    this->samples.fetch_add(1, std::memory_order_relaxed);
+    this->total.fetch_add(micros, std::memory_order_relaxed);
+    storeMax(this->maximum, micros);
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &count : this->counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    this->samples.store(0, std::memory_order_relaxed);
+    this->total.store(0, std::memory_order_relaxed);
+    this->maximum.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Estimates a percentile of the recorded durations.
+ *
+ * @param p The percentile, between 0 and 100.
+ * @return The estimated duration in microseconds, or 0 if nothing has been
+ * recorded.
+ */
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    uint64_t n = this->samples.load(std::memory_order_relaxed);
+    if (!n) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * n + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += this->counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t value = valueOf(i);
+            uint64_t max = this->maximum.load(std::memory_order_relaxed);
+            return value < max ? value : max;
+        }
+    }
+    return this->maximum.load(std::memory_order_relaxed);
+}
+
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary s;
+    s.count = this->samples.load(std::memory_order_relaxed);
+    if (!s.count) {
+        return s;
+    }
+    s.p50 = this->percentile(50);
+    s.p90 = this->percentile(90);
+    s.p99 = this->percentile(99);
+    s.max = this->maximum.load(std::memory_order_relaxed);
+    s.mean = static_cast<double>(this->total.load(std::memory_order_relaxed)) /
+             static_cast<double>(s.count);
+    return s;
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t micros)
+{
+    if (micros < 16) {
+        return static_cast<size_t>(micros);
+    }
+    size_t exponent = 63;
+    while (!(micros >> exponent)) {
+        exponent--;
+    }
+    size_t sub = static_cast<size_t>(micros >> (exponent - 3)) & 7;
+    return 16 + (exponent - 4) * 8 + sub;
+}
+
+/**
+ * Returns the midpoint of the durations which fall into a bucket.
+ */
+uint64_t LatencyHistogram::valueOf(size_t bucket)
+{
+    if (bucket < 16) {
+        return bucket;
+    }
+    size_t exponent = (bucket - 16) / 8 + 4;
+    uint64_t sub = (bucket - 16) % 8;
+    uint64_t width = uint64_t(1) << (exponent - 3);
+    return (8 + sub) * width + width / 2;
+}
+
+ProviderStats::ProviderStats() { this->reset(); }
+
+void ProviderStats::reset()
+{
+    this->evaluate.reset();
+    this->queueWait.reset();
+    this->deserialize.reset();
+    this->cpu.reset();
+    this->evaluations.store(0, std::memory_order_relaxed);
+    this->errors.store(0, std::memory_order_relaxed);
+    this->timeouts.store(0, std::memory_order_relaxed);
+    this->rssGrowth.store(0, std::memory_order_relaxed);
+    this->maxRssGrowth.store(0, std::memory_order_relaxed);
+    this->workerPeakRss.store(0, std::memory_order_relaxed);
+    this->counted.store(0, std::memory_order_relaxed);
+    this->countersAvailable.store(0, std::memory_order_relaxed);
+    this->cycles.store(0, std::memory_order_relaxed);
+    this->instructions.store(0, std::memory_order_relaxed);
+    this->cacheMisses.store(0, std::memory_order_relaxed);
+    this->branchMisses.store(0, std::memory_order_relaxed);
+}
+
+ProviderStatistics ProviderStats::snapshot() const
+{
+    ProviderStatistics s;
+    s.evaluations = this->evaluations.load(std::memory_order_relaxed);
+    s.errors = this->errors.load(std::memory_order_relaxed);
+    s.timeouts = this->timeouts.load(std::memory_order_relaxed);
+    s.evaluate = this->evaluate.summary();
+    s.queueWait = this->queueWait.summary();
+    s.deserialize = this->deserialize.summary();
+    s.cpu = this->cpu.summary();
+    s.rssGrowthKb = this->rssGrowth.load(std::memory_order_relaxed);
+    s.maxRssGrowthKb = this->maxRssGrowth.load(std::memory_order_relaxed);
+    s.workerPeakRssKb = this->workerPeakRss.load(std::memory_order_relaxed);
+    s.counted = this->counted.load(std::memory_order_relaxed);
+    s.counters.available =
+        this->countersAvailable.load(std::memory_order_relaxed);
+    s.counters.cycles = this->cycles.load(std::memory_order_relaxed);
+    s.counters.instructions =
+        this->instructions.load(std::memory_order_relaxed);
+    s.counters.cacheMisses = this->cacheMisses.load(std::memory_order_relaxed);
+    s.counters.branchMisses =
+        this->branchMisses.load(std::memory_order_relaxed);
+    return s;
+}
+
+/**
+ * Adds the hardware events counted during one evaluation.
+ */
+void ProviderStats::recordCounters(const CounterSample &sample)
+{
+    if (!sample.available) {
+        return;
+    }
+    this->counted.fetch_add(1, std::memory_order_relaxed);
+    this->countersAvailable.fetch_or(sample.available,
+                                     std::memory_order_relaxed);
+    this->cycles.fetch_add(sample.cycles, std::memory_order_relaxed);
+    this->instructions.fetch_add(sample.instructions,
+                                 std::memory_order_relaxed);
+    this->cacheMisses.fetch_add(sample.cacheMisses, std::memory_order_relaxed);
+    this->branchMisses.fetch_add(sample.branchMisses,
+                                 std::memory_order_relaxed);
+}
+
+/**
+ * Records the resources used by an evaluation which ran on the thread that
+ * took both samples. The peak RSS is a process-wide high-water mark, so when
+ * providers run concurrently growth is charged to whichever evaluation was
+ * running when it happened.
+ *
+ * @param before A sample taken just before the provider was called.
+ * @param after A sample taken on the same thread once it returned.
+ */
+void ProviderStats::recordUsage(const ResourceSample &before,
+                                const ResourceSample &after)
+{
+    this->cpu.record(after.threadCpuMicros - before.threadCpuMicros);
+    if (after.peakRssKb > before.peakRssKb) {
+        uint64_t growth = after.peakRssKb - before.peakRssKb;
+        this->rssGrowth.fetch_add(growth, std::memory_order_relaxed);
+        storeMax(this->maxRssGrowth, growth);
+    }
+}
+
+/**
+ * Records the resources used by an isolated worker process.
+ *
+ * @param cpuMicros The user and system CPU time of the worker.
+ * @param peakRssKb The peak resident set size of the worker.
+ */
+void ProviderStats::recordWorkerUsage(uint64_t cpuMicros, uint64_t peakRssKb)
+{
+    this->cpu.record(cpuMicros);
+    storeMax(this->workerPeakRss, peakRssKb);
+}
+
+ResourceSample ResourceSample::now()
+{
+    ResourceSample sample;
+#ifndef _WIN32
+    struct timespec cpu;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu) == 0) {
+        sample.threadCpuMicros = static_cast<uint64_t>(cpu.tv_sec) * 1000000 +
+                                 static_cast<uint64_t>(cpu.tv_nsec) / 1000;
+    }
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        // macOS reports bytes rather than kilobytes.
+        sample.peakRssKb = static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+#else
+        sample.peakRssKb = static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+    }
+#endif
+    return sample;
+}
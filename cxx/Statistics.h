@@ -0,0 +1,128 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "HardwareCounters.h"
+#include "ProviderInterface.h"
+
+/**
+ * A summary of the samples recorded by a LatencyHistogram. All values are in
+ * microseconds.
+ */
+struct DLL_EXPORT LatencySummary {
+    uint64_t count = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t max = 0;
+    double mean = 0;
+};
+
+/**
+ * A lock-free histogram of durations in microseconds.
+ *
+ * Values below 16 are counted exactly; larger values fall into one of eight
+ * buckets per power of two, so percentiles are accurate to within 12.5%.
+ * Any number of threads may record samples concurrently.
+ */
+class DLL_EXPORT LatencyHistogram {
+
+  public:
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    void record(uint64_t micros);
+    void reset();
+    uint64_t percentile(double p) const;
+    LatencySummary summary() const;
+
+  private:
+    static const size_t BUCKETS = 16 + 60 * 8;
+    static size_t bucketOf(uint64_t micros);
+    static uint64_t valueOf(size_t bucket);
+
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> maximum;
+};
+
+/**
+ * The CPU time consumed by the calling thread and the peak resident set size
+ * of the process at one instant. Fields are zero where the platform does not
+ * report them.
+ */
+struct DLL_EXPORT ResourceSample {
+    uint64_t threadCpuMicros = 0;
+    uint64_t peakRssKb = 0;
+
+    static ResourceSample now();
+};
+
+/**
+ * A point-in-time copy of the statistics collected for one provider.
+ */
+struct DLL_EXPORT ProviderStatistics {
+    uint64_t evaluations = 0;  /* Completed evaluations */
+    uint64_t errors = 0;       /* Evaluations with a non-zero error code */
+    uint64_t timeouts = 0;     /* Evaluations which exceeded a time limit */
+    LatencySummary evaluate;   /* Time spent inside the provider */
+    LatencySummary queueWait;  /* Time from submission to the provider start */
+    LatencySummary deserialize; /* Time spent parsing the provider result */
+    LatencySummary cpu;        /* CPU time used by the provider */
+    uint64_t rssGrowthKb = 0;  /* Growth of the process peak RSS */
+    uint64_t maxRssGrowthKb = 0; /* Largest growth in a single evaluation */
+    uint64_t workerPeakRssKb = 0; /* Largest peak RSS of an isolated worker */
+    uint64_t counted = 0;      /* Evaluations with hardware counters */
+    CounterSample counters;    /* Hardware events summed over those */
+};
+
+/**
+ * The statistics collected for one provider while BIQT runs it.
+ */
+class DLL_EXPORT ProviderStats {
+
+  public:
+    ProviderStats();
+
+    void reset();
+    ProviderStatistics snapshot() const;
+    void recordUsage(const ResourceSample &before,
+                     const ResourceSample &after);
+    void recordWorkerUsage(uint64_t cpuMicros, uint64_t peakRssKb);
+    void recordCounters(const CounterSample &sample);
+
+    LatencyHistogram evaluate;
+    LatencyHistogram queueWait;
+    LatencyHistogram deserialize;
+    LatencyHistogram cpu;
+    std::atomic<uint64_t> evaluations;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> timeouts;
+    std::atomic<uint64_t> rssGrowth;
+    std::atomic<uint64_t> maxRssGrowth;
+    std::atomic<uint64_t> workerPeakRss;
+    std::atomic<uint64_t> counted;
+    std::atomic<unsigned int> countersAvailable;
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> instructions;
+    std::atomic<uint64_t> cacheMisses;
+    std::atomic<uint64_t> branchMisses;
+};
+
+#endif
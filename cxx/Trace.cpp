@@ -0,0 +1,135 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <fstream>
+#include <iostream>
+#include <json/json.h>
+#include <memory>
+
+#include "Trace.h"
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::~Tracer() { this->stop(); }
+
+/**
+ * Begins collecting spans. Spans collected by an earlier call are discarded.
+ *
+ * @param path The file which stop() writes the trace to.
+ */
+void Tracer::start(const std::string &path)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->path = path;
+    this->origin = Clock::now();
+    this->events.clear();
+    this->active.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Stops collecting spans and writes the trace file.
+ *
+ * @return true if the file was written, false if tracing was not active or
+ * the file could not be opened.
+ */
+bool Tracer::stop()
+{
+    if (!this->active.exchange(false)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::ofstream output(this->path);
+    if (!output) {
+        std::cerr << "Unable to write the trace file " << this->path << "."
+                  << std::endl;
+        return false;
+    }
+
+    Json::Value trace;
+    Json::Value list(Json::arrayValue);
+    for (const auto &event : this->events) {
+        Json::Value e;
+        e["name"] = event.name;
+        e["cat"] = event.category;
+        e["ph"] = "X";
+        e["pid"] = 1;
+        e["tid"] = event.thread;
+        e["ts"] = static_cast<Json::UInt64>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                event.begin - this->origin)
+                .count());
+        e["dur"] = static_cast<Json::UInt64>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                event.end - event.begin)
+                .count());
+        if (!event.detail.empty()) {
+            e["args"]["detail"] = event.detail;
+        }
+        list.append(std::move(e));
+    }
+    trace["traceEvents"] = std::move(list);
+    trace["displayTimeUnit"] = "ms";
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+    writer->write(trace, &output);
+    output << std::endl;
+    this->events.clear();
+    return true;
+}
+
+void Tracer::record(const std::string &name, const char *category,
+                    Clock::time_point begin, Clock::time_point end,
+                    const std::string &detail)
+{
+    if (!this->enabled()) {
+        return;
+    }
+    Event event = {name, category, begin, end, threadId(), detail};
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (begin < this->origin) {
+        return;
+    }
+    this->events.push_back(std::move(event));
+}
+
+/**
+ * Returns a small, stable number for the calling thread.
+ */
+unsigned int Tracer::threadId()
+{
+    static std::atomic<unsigned int> next{1};
+    static thread_local unsigned int id = next.fetch_add(1);
+    return id;
+}
+
+TraceSpan::TraceSpan(const std::string &name, const char *category,
+                     const std::string &detail)
+    : category(category), enabled(Tracer::instance().enabled())
+{
+    if (this->enabled) {
+        this->name = name;
+        this->detail = detail;
+        this->begin = Tracer::Clock::now();
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (this->enabled) {
+        Tracer::instance().record(this->name, this->category, this->begin,
+                                  Tracer::Clock::now(), this->detail);
+    }
+}
@@ -0,0 +1,86 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ProviderInterface.h"
+
+/**
+ * Collects timed spans from every thread and writes them as a Chrome
+ * trace-event JSON file, which can be opened in Perfetto or chrome://tracing.
+ *
+ * Tracing is off until start() is called, either directly or by setting the
+ * BIQT_TRACE environment variable to the output path before BIQT is
+ * constructed. While it is off, spans cost a single atomic load.
+ */
+class DLL_EXPORT Tracer {
+
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static Tracer &instance();
+
+    void start(const std::string &path);
+    bool stop();
+    bool enabled() const { return this->active.load(std::memory_order_relaxed); }
+    void record(const std::string &name, const char *category,
+                Clock::time_point begin, Clock::time_point end,
+                const std::string &detail);
+
+  private:
+    struct Event {
+        std::string name;
+        const char *category;
+        Clock::time_point begin;
+        Clock::time_point end;
+        unsigned int thread;
+        std::string detail;
+    };
+
+    Tracer() = default;
+    ~Tracer();
+    static unsigned int threadId();
+
+    std::atomic<bool> active{false};
+    std::mutex lock;
+    std::string path;
+    Clock::time_point origin;
+    std::vector<Event> events;
+};
+
+/**
+ * Records the lifetime of a scope as a trace span.
+ */
+class DLL_EXPORT TraceSpan {
+
+  public:
+    TraceSpan(const std::string &name, const char *category,
+              const std::string &detail = "");
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+  private:
+    std::string name;
+    const char *category;
+    std::string detail;
+    bool enabled;
+    Tracer::Clock::time_point begin;
+};
+
+#endif
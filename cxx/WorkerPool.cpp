@@ -0,0 +1,148 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include <atomic>
+#include <memory>
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned int threads)
+{
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        this->workers.push_back(std::thread(&WorkerPool::worker, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->changed.notify_all();
+    for (auto &t : this->workers) {
+        t.join();
+    }
+}
+
+/**
+ * Queues a task to run on one of the pool threads.
+ *
+ * @param task The task. It must not throw.
+ */
+void WorkerPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->tasks.push_back(std::move(task));
+    }
+    this->changed.notify_one();
+}
+
+/**
+ * Calls body(i) for each i in [0, count) on the pool threads and the calling
+ * thread, and returns once every call has finished. The calling thread takes
+ * part, so the loop completes even when every pool thread is busy, and a
+ * task running on the pool may itself use parallelFor().
+ *
+ * @param count The number of iterations.
+ * @param body The loop body. It must not throw.
+ */
+void WorkerPool::parallelFor(size_t count,
+                             const std::function<void(size_t)> &body)
+{
+    struct Loop {
+        std::atomic<size_t> next{0};
+        size_t running = 0;
+        bool closed = false;
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<Loop> loop(new Loop());
+    const std::function<void(size_t)> *loopBody = &body;
+
+    size_t helpers = count > 1 ? count - 1 : 0;
+    if (helpers > this->workers.size()) {
+        helpers = this->workers.size();
+    }
+    for (size_t h = 0; h < helpers; h++) {
+        this->submit([loop, loopBody, count]() {
+            {
+                // A helper which starts after the loop has finished must not
+                // touch the body, which belongs to the caller's stack.
+                std::lock_guard<std::mutex> guard(loop->lock);
+                if (loop->closed) {
+                    return;
+                }
+                loop->running++;
+            }
+            for (size_t i = loop->next++; i < count; i = loop->next++) {
+                (*loopBody)(i);
+            }
+            std::lock_guard<std::mutex> guard(loop->lock);
+            if (--loop->running == 0) {
+                loop->finished.notify_all();
+            }
+        });
+    }
+    for (size_t i = loop->next++; i < count; i = loop->next++) {
+        body(i);
+    }
+
+    // Wait only for helpers which are running; queued helpers may be stuck
+    // behind busy pool threads, including the one running this call.
+    std::unique_lock<std::mutex> guard(loop->lock);
+    loop->closed = true;
+    loop->finished.wait(guard, [&loop] { return loop->running == 0; });
+}
+
+unsigned int WorkerPool::size() const
+{
+    return static_cast<unsigned int>(this->workers.size());
+}
+
+/**
+ * Determines whether the calling thread is one of the pool threads, on which
+ * the pool must not be destroyed.
+ */
+bool WorkerPool::isWorkerThread() const
+{
+    std::thread::id self = std::this_thread::get_id();
+    for (const auto &t : this->workers) {
+        if (t.get_id() == self) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::worker()
+{
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (true) {
+        this->changed.wait(guard, [this] {
+            return this->stopping || !this->tasks.empty();
+        });
+        if (this->tasks.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(this->tasks.front());
+        this->tasks.pop_front();
+        guard.unlock();
+        task();
+        guard.lock();
+    }
+}
@@ -0,0 +1,56 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ProviderInterface.h"
+
+/**
+ * A fixed set of threads which run submitted tasks in order of submission.
+ * The destructor returns once every submitted task, including those still
+ * queued, has run.
+ */
+class DLL_EXPORT WorkerPool {
+
+  public:
+    /**
+     * @param threads The number of threads, or 0 for one per hardware thread.
+     */
+    explicit WorkerPool(unsigned int threads = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void submit(std::function<void()> task);
+    void parallelFor(size_t count, const std::function<void(size_t)> &body);
+    unsigned int size() const;
+    bool isWorkerThread() const;
+
+  private:
+    void worker();
+
+    bool stopping = false;
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::thread> workers;
+};
+
+#endif
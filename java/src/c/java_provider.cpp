@@ -8,154 +8,941 @@
 // Copyright 2019 The MITRE Corporation. All Rights Reserved.
 // #######################################################################
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include "Hash.h"
 #include "jnihelper.h"
 #include "org_mitre_biqt_BIQT.h"
 #include "java_provider.h"
+#include "Trace.h"
 
-#define CLASSPATH "providers/BIQTDummy/biqt-0.1-dev.jar:providers/BIQTDummy/json-simple-1.1.1.jar"
+#ifdef _WIN32
+#define PATHSEP ';'
+#else
+#define PATHSEP ':'
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/* The JVM shared by every Java provider in this process. HotSpot supports only
+ * one JVM per process and cannot be restarted once destroyed, so it is never
+ * destroyed. */
+std::mutex jvmLock;
+JavaVM *sharedJvm = nullptr;
+/* Set when the JVM could not be created; it is not attempted again. */
+bool jvmFailed = false;
+
+/* The union of the class paths of all registered Java providers. */
+std::set<std::string> classPathEntries;
+
+/* JVM options requested by provider descriptors, in registration order. */
+std::vector<std::string> providerJvmOptions;
+
+/* Class loaders for providers whose jars are not on the JVM class path, keyed
+ * by class path. Values are global references. */
+std::map<std::string, jobject> classLoaders;
+
+/**
+ * Detaches a thread from the JVM when the thread exits, if BIQT attached it.
+ */
+struct ThreadAttachment {
+    JavaVM *jvm = nullptr;
+    ~ThreadAttachment()
+    {
+        if (this->jvm) {
+            this->jvm->DetachCurrentThread();
+        }
+    }
+};
+
+thread_local ThreadAttachment attachment;
+
+/**
+ * The class, method IDs and idle instances of one Java provider. Instances
+ * are not shared between concurrent evaluations, so the pool grows to the
+ * number of threads evaluating the provider at once.
+ */
+struct JavaProviderClass {
+    jclass cls = nullptr; /* global reference */
+    jmethodID constructor = nullptr;
+    jmethodID evaluate = nullptr;
+    jmethodID evaluateStructured = nullptr; /* null if not overridden */
+    std::mutex lock;
+    std::vector<jobject> idle; /* global references */
+    /* Fields of org.mitre.biqt.StructuredResult, resolved on first use */
+    bool resolvedFields = false;
+    jfieldID providerField = nullptr;
+    jfieldID errorCodeField = nullptr;
+    jfieldID messageField = nullptr;
+    jfieldID keysField = nullptr;
+    jfieldID metricCountField = nullptr;
+    jfieldID detectionsField = nullptr;
+    jfieldID valuesField = nullptr;
+};
+
+/* Cached providers, keyed by provider name and class name. */
+std::map<std::string, std::unique_ptr<JavaProviderClass>> providerClasses;
+
+/* java.lang.Object.toString(), used to serialize results. */
+jmethodID objectToString = nullptr;
+
+std::string joinClassPath()
+{
+    std::string classPath;
+    for (const auto &entry : classPathEntries) {
+        if (classPath.length()) {
+            classPath += PATHSEP;
+        }
+        classPath += entry;
+    }
+    return classPath;
+}
+
+/**
+ * Collects the JVM options. Later options take precedence, so the order is:
+ * $BIQT_HOME/config/jvm.options (one option per line, # starts a comment),
+ * then the "jvmOptions" of provider descriptors, then the whitespace
+ * separated options in $BIQT_JVM_OPTIONS.
+ */
+std::vector<std::string> jvm_options()
+{
+    std::vector<std::string> options;
+    const char *home = getenv("BIQT_HOME");
+    if (home) {
+        std::ifstream config(std::string(home) + "/config/jvm.options");
+        std::string line;
+        while (std::getline(config, line)) {
+            size_t begin = line.find_first_not_of(" \t\r");
+            if (begin == std::string::npos || line[begin] == '#') {
+                continue;
+            }
+            size_t end = line.find_last_not_of(" \t\r");
+            options.push_back(line.substr(begin, end - begin + 1));
+        }
+    }
+    options.insert(options.end(), providerJvmOptions.begin(),
+                   providerJvmOptions.end());
+    const char *env = getenv("BIQT_JVM_OPTIONS");
+    if (env) {
+        std::stringstream words(env);
+        std::string option;
+        while (words >> option) {
+            options.push_back(option);
+        }
+    }
+    return options;
+}
+
+#ifndef _WIN32
+/**
+ * Starts creating an AppCDS archive from a class list by running
+ * $JAVA_HOME/bin/java -Xshare:dump with the same options and class path.
+ * The dump takes seconds, so it runs in a detached process which publishes
+ * the archive for later starts, and which outlives this process if
+ * necessary. The JVM starting now, and the evaluation waiting for it, never
+ * wait for the dump.
+ */
+void start_cds_dump(const std::string &classList, const std::string &archive,
+                    const std::string &classPath,
+                    const std::vector<std::string> &options)
+{
+    const char *javaHome = getenv("JAVA_HOME");
+    if (!javaHome) {
+        std::cerr << "JAVA_HOME is not set; unable to create the class data "
+                     "sharing archive " << archive << "." << std::endl;
+        return;
+    }
+    TraceSpan span("start cds dump", "jvm", archive);
+    std::string java = std::string(javaHome) + "/bin/java";
+    std::string partial = archive + "." + std::to_string(getpid());
+    std::string failure = "Unable to create the class data sharing archive " +
+                          archive + ".\n";
+    std::vector<std::string> args = {java, "-Xshare:dump",
+                                     "-XX:SharedClassListFile=" + classList,
+                                     "-XX:SharedArchiveFile=" + partial,
+                                     "-Djava.class.path=" + classPath};
+    args.insert(args.end(), options.begin(), options.end());
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    // Other threads may hold locks, so the children only make
+    // async-signal-safe calls until exec. The first child exits at once,
+    // which leaves the process waiting for the dump without a parent here.
+    pid_t pid = fork();
+    if (pid < 0) {
+        return;
+    }
+    if (pid == 0) {
+        if (fork() != 0) {
+            _exit(0);
+        }
+        pid_t dump = fork();
+        if (dump == 0) {
+            // The dump prints a summary which is of no use to BIQT users.
+            int null = open("/dev/null", O_WRONLY);
+            if (null >= 0) {
+                dup2(null, STDOUT_FILENO);
+            }
+            execv(java.c_str(), argv.data());
+            _exit(127);
+        }
+        int status = 0;
+        while (dump > 0 && waitpid(dump, &status, 0) < 0 && errno == EINTR) {
+        }
+        // Publish the archive atomically so concurrent starts never map a
+        // partially written file.
+        if (dump > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+            rename(partial.c_str(), archive.c_str()) == 0) {
+            _exit(0);
+        }
+        unlink(partial.c_str());
+        ssize_t ignored = write(STDERR_FILENO, failure.data(), failure.size());
+        (void)ignored;
+        _exit(1);
+    }
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {
+    }
+}
+#endif
+
+/**
+ * Chooses the class data sharing options when $BIQT_JAVA_CDS_DIR is set.
+ * Archives are named after the class path and options they were created
+ * with. The first JVM records the classes it loads; the next start creates
+ * the archive from that list in the background and every start after it is
+ * ready maps it, which avoids parsing and verifying the provider classes
+ * again.
+ */
+std::vector<std::string> cds_options(const std::string &classPath,
+                                     const std::vector<std::string> &options)
+{
+    const char *dir = getenv("BIQT_JAVA_CDS_DIR");
+    if (!dir || !*dir) {
+        return std::vector<std::string>();
+    }
+    std::string key = classPath;
+    for (const auto &option : options) {
+        key += '\n' + option;
+    }
+    std::string base = std::string(dir) + "/biqt-" + fnv1a(key);
+    std::string archive = base + ".jsa";
+    std::string classList = base + ".classlist";
+    std::ifstream existing(archive);
+    if (existing.good()) {
+        return {"-XX:SharedArchiveFile=" + archive, "-Xshare:auto"};
+    }
+#ifndef _WIN32
+    std::ifstream recorded(classList);
+    if (recorded.good()) {
+        start_cds_dump(classList, archive, classPath, options);
+        return std::vector<std::string>();
+    }
+    mkdir(dir, 0700);
+    return {"-XX:DumpLoadedClassList=" + classList};
+#else
+    return std::vector<std::string>();
+#endif
+}
 
 /**
  * Initializes the Java Virtual Machine.
  *
  * @param jvm An uninitialized pointer to a pointer to the JVM
  * @param env An uninitialized pointer to a pointer to the JNI environment
- * @param cls An uninitialized pointer for the Java class
- * @param className The name of the java class to load into the JVM
- * @return
+ * @param classPath The class path of the JVM
+ * @return 0 on success, -1 on failure
  */
-int init_jvm(JavaVM **jvm, JNIEnv **env, jclass *cls, std::string className,
-             std::string classPath)
+int init_jvm(JavaVM **jvm, JNIEnv **env, const std::string &classPath)
 {
-    std::string classPathOption = "-Djava.class.path=" + classPath;
+    TraceSpan span("jvm startup", "jvm");
+    std::vector<std::string> tuning = jvm_options();
+    std::vector<std::string> optionStrings = {"-Djava.class.path=" + classPath};
+    optionStrings.insert(optionStrings.end(), tuning.begin(), tuning.end());
+    std::vector<std::string> cds = cds_options(classPath, tuning);
+    optionStrings.insert(optionStrings.end(), cds.begin(), cds.end());
     /* ================= prepare loading of Java VM ========================== */
     JavaVMInitArgs vm_args;                        // Initialization arguments
-    JavaVMOption *options = new JavaVMOption[1];   // JVM invocation options
-    options[0].optionString = const_cast<char *>(classPathOption.c_str());
+    std::vector<JavaVMOption> options(optionStrings.size()); // JVM invocation options
+    for (size_t i = 0; i < optionStrings.size(); i++) {
+        options[i].optionString = const_cast<char *>(optionStrings[i].c_str());
+        options[i].extraInfo = nullptr;
+    }
     vm_args.version = JNI_VERSION_10;             // minimum Java version
-    vm_args.nOptions = 1;                          // number of options
-    vm_args.options = options;
+    vm_args.nOptions = (jint)options.size();       // number of options
+    vm_args.options = options.data();
     vm_args.ignoreUnrecognized = false;  // invalid options make the init fail
     /* ============ load and initialize Java VM and JNI interface =========== */
-    jint rc = JNI_CreateJavaVM(jvm, (void**)env, &vm_args);  // YES !!
-    delete[] options;    // we then no longer need the initialization options.
+    jint rc = JNI_CreateJavaVM(jvm, (void**)env, &vm_args);
     /* ============== Check for initialization errors ======================= */
     if (rc != JNI_OK) {
-        // TO DO: error processing...
-        std::cerr << "Unable to initialize the JVM" << std::endl;
+        std::cerr << "Unable to initialize the JVM with the options:";
+        for (const auto &option : optionStrings) {
+            std::cerr << " " << option;
+        }
+        std::cerr << std::endl;
+        *jvm = nullptr;
         return -1;
     }
+    return 0;
+}
 
-    *cls = (*env)->FindClass(className.c_str());
-    if (*cls == nullptr) {
-        std::cerr << "Unable to locate the class " << className << std::endl;
-        return -1;
+/**
+ * Returns the JVM of this process, creating it on first use. A JVM which
+ * already exists, for example because BIQT was loaded by a Java application,
+ * is reused.
+ *
+ * @return The JVM, or nullptr if it could not be created.
+ */
+JavaVM *get_jvm()
+{
+    std::lock_guard<std::mutex> guard(jvmLock);
+    if (sharedJvm || jvmFailed) {
+        return sharedJvm;
     }
+    JavaVM *existing = nullptr;
+    jsize count = 0;
+    if (JNI_GetCreatedJavaVMs(&existing, 1, &count) == JNI_OK && count > 0) {
+        sharedJvm = existing;
+        return sharedJvm;
+    }
+    // The creating thread is attached by JNI_CreateJavaVM and stays attached.
+    // A failed JNI_CreateJavaVM may leave the VM partly initialized, and
+    // HotSpot does not support creating another one in the same process.
+    JNIEnv *env;
+    if (init_jvm(&sharedJvm, &env, joinClassPath()) != 0) {
+        jvmFailed = true;
+    }
+    return sharedJvm;
+}
 
-//    /* ============== Display JVM version ================================= */
-//    std::cout << "JVM load succeeded: Version ";
-//    jint ver = env->GetVersion();
-//    std::cout << ((ver>>16)&0x0f) << "."<<(ver&0x0f) << std::endl;
-
-    return 0;
+/**
+ * Returns the JNI environment of the calling thread, attaching the thread to
+ * the shared JVM if necessary. Threads attached here are detached when they
+ * exit.
+ *
+ * @return The JNI environment, or nullptr on failure.
+ */
+JNIEnv *attach_jvm()
+{
+    JavaVM *jvm = get_jvm();
+    if (!jvm) {
+        return nullptr;
+    }
+    JNIEnv *env = nullptr;
+    jint rc = jvm->GetEnv((void **)&env, JNI_VERSION_10);
+    if (rc == JNI_OK) {
+        return env;
+    }
+    if (rc != JNI_EDETACHED) {
+        return nullptr;
+    }
+    // Daemon threads do not hold up the shutdown of a hosting application.
+    if (jvm->AttachCurrentThreadAsDaemon((void **)&env, nullptr) != JNI_OK) {
+        std::cerr << "Unable to attach a thread to the JVM" << std::endl;
+        return nullptr;
+    }
+    attachment.jvm = jvm;
+    return env;
 }
 
-void destroy_jvm(JavaVM *jvm)
+/**
+ * Creates a class loader for the jar files of a provider which are not on the
+ * class path of the JVM.
+ *
+ * @return A local reference to the class loader, or nullptr on failure.
+ */
+jobject new_class_loader(JNIEnv *env, const std::string &classPath)
 {
-    jvm->DestroyJavaVM();
+    jclass fileClass = env->FindClass("java/io/File");
+    jclass uriClass = env->FindClass("java/net/URI");
+    jclass urlClass = env->FindClass("java/net/URL");
+    jclass loaderClass = env->FindClass("java/net/URLClassLoader");
+    if (!fileClass || !uriClass || !urlClass || !loaderClass) {
+        return nullptr;
+    }
+    jmethodID fileConstructor =
+        env->GetMethodID(fileClass, "<init>", "(Ljava/lang/String;)V");
+    jmethodID toURI = env->GetMethodID(fileClass, "toURI", "()Ljava/net/URI;");
+    jmethodID toURL = env->GetMethodID(uriClass, "toURL", "()Ljava/net/URL;");
+    jmethodID loaderConstructor =
+        env->GetMethodID(loaderClass, "<init>", "([Ljava/net/URL;)V");
+    if (!fileConstructor || !toURI || !toURL || !loaderConstructor) {
+        return nullptr;
+    }
+
+    std::vector<std::string> entries;
+    std::stringstream paths(classPath);
+    std::string entry;
+    while (std::getline(paths, entry, PATHSEP)) {
+        if (!entry.empty()) {
+            entries.push_back(entry);
+        }
+    }
+    jobjectArray urls = env->NewObjectArray(static_cast<jsize>(entries.size()),
+                                            urlClass, nullptr);
+    if (!urls) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        jstring path = env->NewStringUTF(entries[i].c_str());
+        jobject file = env->NewObject(fileClass, fileConstructor, path);
+        jobject uri = file ? env->CallObjectMethod(file, toURI) : nullptr;
+        jobject url = uri ? env->CallObjectMethod(uri, toURL) : nullptr;
+        if (env->ExceptionCheck() || !url) {
+            return nullptr;
+        }
+        env->SetObjectArrayElement(urls, static_cast<jsize>(i), url);
+        env->DeleteLocalRef(path);
+        env->DeleteLocalRef(file);
+        env->DeleteLocalRef(uri);
+        env->DeleteLocalRef(url);
+    }
+    return env->NewObject(loaderClass, loaderConstructor, urls);
 }
 
 /**
- * A function to begin provider analysis.
+ * Finds a provider class, first on the class path of the JVM and then in the
+ * provider's own jar files.
  *
- * @param filePath The path to the input file.
- * @param providerName This should be the provider *directory* name where the
- * jar files can be found.
- * @param className The name of the Provider class to use for evaluation. This
- * should be the fully qualified class name, e.g.
- * org/mitre/biqt/IrisProvider
- * @param classPath The java class path required for this provider.
+ * @param className The class name, e.g. org/mitre/biqt/IrisProvider
+ * @param classPath The class path of the provider.
+ * @return A local reference to the class, or nullptr if it was not found.
+ */
+jclass find_provider_class(JNIEnv *env, const std::string &className,
+                           const std::string &classPath)
+{
+    jclass cls = env->FindClass(className.c_str());
+    if (cls) {
+        return cls;
+    }
+    env->ExceptionClear();
+
+    jobject loader = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(jvmLock);
+        auto found = classLoaders.find(classPath);
+        if (found != classLoaders.end()) {
+            loader = found->second;
+        }
+    }
+    if (!loader) {
+        jobject local = new_class_loader(env, classPath);
+        if (!local) {
+            env->ExceptionClear();
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> guard(jvmLock);
+        auto found = classLoaders.find(classPath);
+        if (found == classLoaders.end()) {
+            found = classLoaders
+                        .insert(std::make_pair(classPath,
+                                               env->NewGlobalRef(local)))
+                        .first;
+        }
+        loader = found->second;
+        env->DeleteLocalRef(local);
+    }
+
+    jclass loaderClass = env->FindClass("java/lang/ClassLoader");
+    jmethodID loadClass = env->GetMethodID(
+        loaderClass, "loadClass", "(Ljava/lang/String;)Ljava/lang/Class;");
+    std::string binaryName = className;
+    for (auto &c : binaryName) {
+        if (c == '/') {
+            c = '.';
+        }
+    }
+    jstring jname = env->NewStringUTF(binaryName.c_str());
+    cls = (jclass)env->CallObjectMethod(loader, loadClass, jname);
+    env->DeleteLocalRef(jname);
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        return nullptr;
+    }
+    return cls;
+}
+
+/**
+ * Copies a Java string into a std::string.
+ */
+std::string to_string(JNIEnv *env, jstring value)
+{
+    if (!value) {
+        return "";
+    }
+    const char *chars = env->GetStringUTFChars(value, NULL);
+    if (!chars) {
+        env->ExceptionClear();
+        return "";
+    }
+    std::string copy(chars);
+    env->ReleaseStringUTFChars(value, chars);
+    return copy;
+}
+
+/**
+ * Determines whether a provider class overrides a method it inherits from
+ * org.mitre.biqt.Provider.
+ */
+bool overrides_base(JNIEnv *env, jclass cls, jmethodID method)
+{
+    jobject reflected = env->ToReflectedMethod(cls, method, JNI_FALSE);
+    jmethodID getDeclaringClass =
+        jni_get_method(env, env->FindClass("java/lang/reflect/Method"),
+                       "getDeclaringClass", "()Ljava/lang/Class;");
+    jmethodID getName = jni_get_method(env, env->FindClass("java/lang/Class"),
+                                       "getName", "()Ljava/lang/String;");
+    if (!reflected || !getDeclaringClass || !getName) {
+        env->ExceptionClear();
+        return true;
+    }
+    jobject declaring = env->CallObjectMethod(reflected, getDeclaringClass);
+    jstring name =
+        declaring ? (jstring)env->CallObjectMethod(declaring, getName) : nullptr;
+    bool overridden = env->ExceptionCheck() ||
+                      to_string(env, name) != "org.mitre.biqt.Provider";
+    env->ExceptionClear();
+    env->DeleteLocalRef(name);
+    env->DeleteLocalRef(declaring);
+    env->DeleteLocalRef(reflected);
+    return overridden;
+}
+
+/**
+ * Returns the cached class and method IDs of a provider, resolving them on
+ * first use.
  *
- * @return The return status of the provider.
+ * @return The cached provider, or nullptr if it could not be resolved.
  */
-const char *java_provider_eval(const char *filePath, const char *providerName,
-                               const char *className, const char *classPath)
+JavaProviderClass *get_provider_class(JNIEnv *env, const std::string &key,
+                                      const char *className,
+                                      const char *classPath)
 {
-    JavaVM *jvm;
-    JNIEnv *env;
-    jclass cls, jsonObject;
-    jobject provider, jsonResult;
-    jstring jfilename, jresultStr;
-    jmethodID constructor, execMethod, toStringMethod;
-    const char *result;
-    char *returnvalue;
-    (void)providerName;
+    {
+        std::lock_guard<std::mutex> guard(jvmLock);
+        auto found = providerClasses.find(key);
+        if (found != providerClasses.end()) {
+            return found->second.get();
+        }
+    }
 
-    if (init_jvm(&jvm, &env, &cls, className, classPath)) {
+    std::unique_ptr<JavaProviderClass> entry(new JavaProviderClass());
+    jclass cls = find_provider_class(env, className, classPath);
+    if (!cls) {
+        std::cerr << "Unable to locate the class " << className << std::endl;
         return nullptr;
     }
-    if (!(constructor = jni_get_method(env, cls, "<init>", "()V"))) {
-        // log the error;
+    if (!(entry->constructor = jni_get_method(env, cls, "<init>", "()V"))) {
         std::cerr << "Unable to locate the constructor for" << className
                   << std::endl;
-        destroy_jvm(jvm);
+        env->ExceptionClear();
         return nullptr;
     }
-    if (!(execMethod = jni_get_method(env, cls, "evaluate",
-                                      "(Ljava/lang/String;)"
-                                      "Lorg/json/simple/JSONObject;"))) {
-        // log error
+    if (!(entry->evaluate = jni_get_method(env, cls, "evaluate",
+                                           "(Ljava/lang/String;)"
+                                           "Lorg/json/simple/JSONObject;"))) {
         std::cerr << "Unable to locate the evaluate method for " << className
                   << std::endl;
-        destroy_jvm(jvm);
+        env->ExceptionClear();
         return nullptr;
     }
-    jfilename = env->NewStringUTF(filePath);
-    provider = env->NewObject(cls, constructor);
-    jsonResult = env->CallObjectMethod(provider, execMethod, jfilename);
-    env->DeleteLocalRef(jfilename);
-    if (env->ExceptionCheck() || !jsonResult) {
+    // Providers which predate StructuredResult do not declare the method,
+    // and providers which do not override it always return null.
+    entry->evaluateStructured = env->GetMethodID(
+        cls, "evaluateStructured",
+        "(Ljava/lang/String;)Lorg/mitre/biqt/StructuredResult;");
+    if (!entry->evaluateStructured) {
+        env->ExceptionClear();
+    }
+    else if (!overrides_base(env, cls, entry->evaluateStructured)) {
+        entry->evaluateStructured = nullptr;
+    }
+    jmethodID toString = jni_get_method(
+        env, env->FindClass("java/lang/Object"), "toString",
+        "()Ljava/lang/String;");
+    if (!toString) {
+        env->ExceptionClear();
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> guard(jvmLock);
+    objectToString = toString;
+    auto found = providerClasses.find(key);
+    if (found != providerClasses.end()) {
+        return found->second.get();
+    }
+    entry->cls = (jclass)env->NewGlobalRef(cls);
+    JavaProviderClass *provider = entry.get();
+    providerClasses[key] = std::move(entry);
+    return provider;
+}
+
+/**
+ * Takes an idle provider instance from the pool or constructs a new one.
+ *
+ * @return A global reference to the instance, or nullptr on failure.
+ */
+jobject acquire_instance(JNIEnv *env, JavaProviderClass *provider)
+{
+    {
+        std::lock_guard<std::mutex> guard(provider->lock);
+        if (!provider->idle.empty()) {
+            jobject instance = provider->idle.back();
+            provider->idle.pop_back();
+            return instance;
+        }
+    }
+    jobject local = env->NewObject(provider->cls, provider->constructor);
+    if (env->ExceptionCheck() || !local) {
         env->ExceptionDescribe();
         env->ExceptionClear();
-        destroy_jvm(jvm);
         return nullptr;
     }
+    jobject instance = env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    return instance;
+}
 
-    jsonObject = env->FindClass("org/json/simple/JSONObject");
-    if (!jsonObject) {
-        std::cerr << "Unable to locate the class org/json/simple/JSONObject"
-                  << std::endl;
-        destroy_jvm(jvm);
+void release_instance(JavaProviderClass *provider, jobject instance)
+{
+    std::lock_guard<std::mutex> guard(provider->lock);
+    provider->idle.push_back(instance);
+}
+
+/**
+ * Evaluates a file with a pooled provider instance, preferring
+ * evaluateStructured() when the provider implements it.
+ *
+ * @param structured Set to whether the result is a StructuredResult.
+ * @return A local reference to the result, or nullptr on failure.
+ */
+jobject call_provider(JNIEnv *env, JavaProviderClass *provider,
+                      const char *filePath, bool &structured)
+{
+    jobject instance = acquire_instance(env, provider);
+    if (!instance) {
         return nullptr;
     }
 
-    if (!(toStringMethod = jni_get_method(env, jsonObject, "toString",
-                                          "()Ljava/lang/String;"))) {
-        // log error
-        std::cerr << "Unable to locate the toString method for"
-                " org/json/simple/JSONObject" << std::endl;
-        destroy_jvm(jvm);
+    jstring jfilename = env->NewStringUTF(filePath);
+    jobject result = nullptr;
+    structured = false;
+    if (provider->evaluateStructured) {
+        result = env->CallObjectMethod(instance, provider->evaluateStructured,
+                                       jfilename);
+        structured = result != nullptr && !env->ExceptionCheck();
+    }
+    if (!result && !env->ExceptionCheck()) {
+        result = env->CallObjectMethod(instance, provider->evaluate, jfilename);
+    }
+    env->DeleteLocalRef(jfilename);
+    if (env->ExceptionCheck() || !result) {
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+        // The instance may have been left in an inconsistent state.
+        env->DeleteGlobalRef(instance);
         return nullptr;
     }
-    jresultStr = (jstring)(env->CallObjectMethod(jsonResult, toStringMethod));
+    release_instance(provider, instance);
+    return result;
+}
+
+/**
+ * Converts a StructuredResult into an EvaluationResult.
+ *
+ * @return true on success, false if the result was malformed.
+ */
+bool read_structured(JNIEnv *env, JavaProviderClass *provider, jobject object,
+                     Provider::EvaluationResult &result)
+{
+    {
+        std::lock_guard<std::mutex> guard(provider->lock);
+        if (!provider->resolvedFields) {
+            jclass cls = env->GetObjectClass(object);
+            provider->providerField =
+                env->GetFieldID(cls, "provider", "Ljava/lang/String;");
+            provider->errorCodeField = env->GetFieldID(cls, "errorCode", "I");
+            provider->messageField =
+                env->GetFieldID(cls, "message", "Ljava/lang/String;");
+            provider->keysField =
+                env->GetFieldID(cls, "keys", "[Ljava/lang/String;");
+            provider->metricCountField =
+                env->GetFieldID(cls, "metricCount", "I");
+            provider->detectionsField = env->GetFieldID(cls, "detections", "I");
+            provider->valuesField = env->GetFieldID(cls, "values", "[D");
+            if (env->ExceptionCheck()) {
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+                return false;
+            }
+            provider->resolvedFields = true;
+        }
+    }
+
+    result.errorCode = env->GetIntField(object, provider->errorCodeField);
+    result.provider = to_string(
+        env, (jstring)env->GetObjectField(object, provider->providerField));
+    result.message = to_string(
+        env, (jstring)env->GetObjectField(object, provider->messageField));
+
+    jobjectArray jkeys =
+        (jobjectArray)env->GetObjectField(object, provider->keysField);
+    jdoubleArray jvalues =
+        (jdoubleArray)env->GetObjectField(object, provider->valuesField);
+    jint metricCount = env->GetIntField(object, provider->metricCountField);
+    jint detections = env->GetIntField(object, provider->detectionsField);
+    if (!jkeys || !jvalues || detections < 0) {
+        return false;
+    }
+
+    // Strings must be copied before entering the critical region, in which
+    // no other JNI functions may be called.
+    jsize keyCount = env->GetArrayLength(jkeys);
+    std::vector<std::string> keys;
+    keys.reserve(static_cast<size_t>(keyCount));
+    for (jsize k = 0; k < keyCount; k++) {
+        jstring key = (jstring)env->GetObjectArrayElement(jkeys, k);
+        keys.push_back(to_string(env, key));
+        env->DeleteLocalRef(key);
+    }
+    if (env->GetArrayLength(jvalues) !=
+        static_cast<jsize>(detections) * keyCount) {
+        return false;
+    }
+
+    result.qualityResult.resize(static_cast<size_t>(detections));
+    const double *values =
+        (const double *)env->GetPrimitiveArrayCritical(jvalues, NULL);
+    if (!values) {
+        env->ExceptionClear();
+        return false;
+    }
+    for (jint d = 0; d < detections; d++) {
+        Provider::QualityResult &quality = result.qualityResult[d];
+        const double *row = values + static_cast<size_t>(d) * keyCount;
+        for (jsize k = 0; k < keyCount; k++) {
+            if (std::isnan(row[k])) {
+                continue;
+            }
+            // Narrowed like the values of JSON results, which are read with
+            // asFloat(), so both paths report the same numbers.
+            double value = static_cast<float>(row[k]);
+            if (k < metricCount) {
+                quality.metrics.emplace_hint(quality.metrics.end(), keys[k],
+                                             value);
+            }
+            else {
+                quality.features.emplace_hint(quality.features.end(), keys[k],
+                                              value);
+            }
+        }
+    }
+    env->ReleasePrimitiveArrayCritical(jvalues, (void *)values, JNI_ABORT);
+    return true;
+}
+
+/**
+ * Copies a provider's JSON result into a new[] allocated string.
+ *
+ * @return The serialized result, or nullptr on failure.
+ */
+char *to_json_string(JNIEnv *env, jobject jsonResult)
+{
+    jstring jresultStr =
+        (jstring)(env->CallObjectMethod(jsonResult, objectToString));
     if (env->ExceptionCheck() || !jresultStr) {
         env->ExceptionDescribe();
         env->ExceptionClear();
-        destroy_jvm(jvm);
         return nullptr;
     }
 
-    result = env->GetStringUTFChars(jresultStr, NULL);
+    const char *result = env->GetStringUTFChars(jresultStr, NULL);
     if (!result) {
-        destroy_jvm(jvm);
         return nullptr;
     }
-    returnvalue = new char[strlen(result) + 1];
+    char *returnvalue = new char[strlen(result) + 1];
     strcpy(returnvalue, result);
-    env->ReleaseStringUTFChars(jresultStr, NULL);
-    destroy_jvm(jvm);
+    env->ReleaseStringUTFChars(jresultStr, result);
     return returnvalue;
 }
+
+/**
+ * Evaluates a file and returns the result as JSON. Local references are
+ * released by the caller.
+ *
+ * @return The serialized result, or nullptr on failure.
+ */
+char *evaluate_in_jvm(JNIEnv *env, const char *filePath,
+                      const char *providerName, const char *className,
+                      const char *classPath)
+{
+    std::string key = std::string(providerName) + "\n" + className;
+    JavaProviderClass *provider =
+        get_provider_class(env, key, className, classPath);
+    if (!provider) {
+        return nullptr;
+    }
+    bool structured;
+    jobject result = call_provider(env, provider, filePath, structured);
+    if (!result) {
+        return nullptr;
+    }
+    if (!structured) {
+        return to_json_string(env, result);
+    }
+    Provider::EvaluationResult parsed;
+    if (!read_structured(env, provider, result, parsed)) {
+        return nullptr;
+    }
+    return Provider::serializeResult(parsed);
+}
+
+/**
+ * Evaluates a file and converts the result straight to an EvaluationResult.
+ * Local references are released by the caller.
+ *
+ * @return true on success.
+ */
+bool evaluate_result_in_jvm(JNIEnv *env, const char *filePath,
+                            const char *providerName, const char *className,
+                            const char *classPath,
+                            Provider::EvaluationResult &result)
+{
+    std::string key = std::string(providerName) + "\n" + className;
+    JavaProviderClass *provider =
+        get_provider_class(env, key, className, classPath);
+    if (!provider) {
+        return false;
+    }
+    bool structured;
+    jobject object = call_provider(env, provider, filePath, structured);
+    if (!object) {
+        return false;
+    }
+    if (structured) {
+        return read_structured(env, provider, object, result);
+    }
+    std::unique_ptr<char[]> serialized(to_json_string(env, object));
+    if (!serialized) {
+        return false;
+    }
+    result = Provider::deserializeResult(serialized.get());
+    return true;
+}
+
+} // namespace
+
+/**
+ * Adds the jar files of a Java provider to the class path of the shared JVM.
+ * Providers should be registered before the first Java evaluation; the jars
+ * of providers registered later are loaded through a separate class loader.
+ *
+ * @param classPath The class path of the provider.
+ */
+void java_provider_register(const char *classPath,
+                            const std::vector<std::string> &jvmOptions)
+{
+    std::lock_guard<std::mutex> guard(jvmLock);
+    for (const auto &option : jvmOptions) {
+        if (sharedJvm) {
+            std::cerr << "Ignoring JVM option " << option
+                      << ": the JVM is already running." << std::endl;
+            continue;
+        }
+        if (std::find(providerJvmOptions.begin(), providerJvmOptions.end(),
+                      option) == providerJvmOptions.end()) {
+            providerJvmOptions.push_back(option);
+        }
+    }
+    std::stringstream entries(classPath);
+    std::string entry;
+    while (std::getline(entries, entry, PATHSEP)) {
+        if (!entry.empty()) {
+            classPathEntries.insert(entry);
+        }
+    }
+}
+
+/**
+ * A function to begin provider analysis.
+ *
+ * @param filePath The path to the input file.
+ * @param providerName This should be the provider *directory* name where the
+ * jar files can be found.
+ * @param className The name of the Provider class to use for evaluation. This
+ * should be the fully qualified class name, e.g.
+ * org/mitre/biqt/IrisProvider
+ * @param classPath The java class path required for this provider.
+ *
+ * @return The return status of the provider.
+ */
+const char *java_provider_eval(const char *filePath, const char *providerName,
+                               const char *className, const char *classPath)
+{
+    JNIEnv *env = attach_jvm();
+    if (!env) {
+        return nullptr;
+    }
+    // Threads attached from native code never return to Java, so local
+    // references must be released explicitly.
+    if (env->PushLocalFrame(32) != JNI_OK) {
+        env->ExceptionClear();
+        return nullptr;
+    }
+    char *returnvalue =
+        evaluate_in_jvm(env, filePath, providerName, className, classPath);
+    env->PopLocalFrame(nullptr);
+    return returnvalue;
+}
+
+/**
+ * Evaluates a file with a Java provider. Results returned as a
+ * StructuredResult are converted without going through JSON.
+ *
+ * @param filePath The path to the input file.
+ * @param providerName The name of the provider.
+ * @param className The fully qualified class name of the provider.
+ * @param classPath The java class path required for this provider.
+ * @param result Receives the result.
+ *
+ * @return 0 on success, Provider::GENERIC_ERROR on failure.
+ */
+int java_provider_evaluate(const char *filePath, const char *providerName,
+                           const char *className, const char *classPath,
+                           Provider::EvaluationResult &result)
+{
+    JNIEnv *env = attach_jvm();
+    if (!env) {
+        return Provider::GENERIC_ERROR;
+    }
+    if (env->PushLocalFrame(32) != JNI_OK) {
+        env->ExceptionClear();
+        return Provider::GENERIC_ERROR;
+    }
+    bool ok = evaluate_result_in_jvm(env, filePath, providerName, className,
+                                     classPath, result);
+    env->PopLocalFrame(nullptr);
+    return ok ? 0 : Provider::GENERIC_ERROR;
+}
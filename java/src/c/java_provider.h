@@ -23,4 +23,26 @@
 const char *java_provider_eval(const char *filePath, const char *providerName,
                                const char *className, const char *classPath);
 
+/**
+ * Evaluates a file with a Java provider and returns the parsed result.
+ * Providers which return an org.mitre.biqt.StructuredResult are read
+ * directly, without a JSON round trip.
+ *
+ * @return 0 on success, Provider::GENERIC_ERROR on failure.
+ */
+int java_provider_evaluate(const char *filePath, const char *providerName,
+                           const char *className, const char *classPath,
+                           Provider::EvaluationResult &result);
+
+/**
+ * Adds the jar files of a Java provider to the class path of the JVM shared
+ * by all Java providers in this process.
+ *
+ * @param classPath The class path required for the provider.
+ * @param jvmOptions Options the provider requests for the JVM, e.g. "-Xmx2g".
+ */
+void java_provider_register(
+    const char *classPath,
+    const std::vector<std::string> &jvmOptions = std::vector<std::string>());
+
 #endif //BIQT_JAVA_PROVIDER_H
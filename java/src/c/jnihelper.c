@@ -16,41 +16,6 @@
 #define snprintf _snprintf
 #endif
 
-/**
- *	Gets a pointer from the java object (stored as a long).
- *
- * @param env The java environment
- * @param obj The object to retrieve the pointer from
- * @param name The name of the java long storing the pointer value
- *
- * @return The retrieved pointer.
- */
-void *jni_get_pointer(JNIEnv *env, jobject obj, const char *name)
-{
-    void *ptr;
-
-    jclass jcls = (*env)->GetObjectClass(env, obj);
-    jfieldID ptr_id = (*env)->GetFieldID(env, jcls, name, "J");
-    ptr = (void *)((*env)->GetLongField(env, obj, ptr_id));
-
-    return ptr;
-}
-
-/**
- * Sets a pointer in the java object (stored as a long.
- *
- * @param env The java environment
- * @param obj The object to set the pointer inside
- * @param name The name of the long which will store the pointer value.
- * @param ptr The pointer to be stored.
- */
-void jni_set_pointer(JNIEnv *env, jobject obj, const char *name, void *ptr)
-{
-    jclass jcls = (*env)->GetObjectClass(env, obj);
-    jfieldID ptr_id = (*env)->GetFieldID(env, jcls, name, "J");
-    (*env)->SetLongField(env, obj, ptr_id, (long)ptr);
-}
-
 /**
  * Throws a java exception once java regains control. Best practice is to return
  * from native code immediately after calling this method. Not doing so may have
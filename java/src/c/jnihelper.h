@@ -17,8 +17,6 @@
 extern "C" {
 #endif
 
-void *jni_get_pointer(JNIEnv *, jobject, const char *name);
-void jni_set_pointer(JNIEnv *, jobject, const char *name, void *ptr);
 jint jni_throw_exception(JNIEnv *, const char *exception, const char *message);
 jclass jni_get_class(JNIEnv *, const char *class_name);
 jmethodID jni_get_method(JNIEnv *, jclass, const char *method_name,
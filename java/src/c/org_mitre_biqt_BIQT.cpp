@@ -8,14 +8,590 @@
 // Copyright 2019 The MITRE Corporation. All Rights Reserved.
 // #######################################################################
 
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 #include "org_mitre_biqt_BIQT.h"
 #include "BIQT.h"
 #include "ProviderInterface.h"
 #include "jnihelper.h"
 
+namespace {
+
+/**
+ * Serializes the results of a modality into the string returned to Java. The
+ * result of a single provider is returned as it is, as it always has been.
+ * Results of several providers, which used to be concatenated into invalid
+ * JSON, are returned as an object which maps each provider name to its
+ * result.
+ */
+std::string
+serialize_modality(const std::map<std::string, Provider::EvaluationResult> &result)
+{
+    Json::Value results(Json::objectValue);
+    if (result.size() == 1) {
+        results = Provider::resultToJson(result.begin()->second);
+    }
+    else {
+        for (const auto &iter : result) {
+            results[iter.first] = Provider::resultToJson(iter.second);
+        }
+    }
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, results);
+}
+
+/**
+ * The Java classes, fields and methods used by the native methods. They are
+ * resolved once in JNI_OnLoad, and the classes are held as global references
+ * so that they remain usable from native threads, where FindClass cannot see
+ * application classes.
+ */
+struct JavaTypes {
+    jfieldID biqtPtr;
+    jclass stringClass;
+    jclass listClass;
+    jmethodID listConstructor;
+    jmethodID listAdd;
+    jclass providerInfoClass;
+    jmethodID providerInfoConstructor;
+    jclass resultClass;
+    jmethodID resultConstructor;
+    jclass mapInterface;
+    jclass mapClass;
+    jmethodID mapConstructor;
+    jmethodID mapPut;
+    jmethodID futureComplete;
+    jmethodID futureCompleteExceptionally;
+};
+
+JavaTypes javaTypes;
+
+jclass global_class(JNIEnv *env, const char *name)
+{
+    jclass local = jni_get_class(env, name);
+    if (!local) {
+        return nullptr;
+    }
+    jclass global = (jclass)env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    return global;
+}
+
 /**
- * Initializes a Java BIQT object.
+ * Resolves javaTypes. This runs on the Java thread which loads the library,
+ * so application classes are visible.
+ *
+ * @return true on success, false if a Java exception is pending.
+ */
+bool load_java_types(JNIEnv *env)
+{
+    JavaTypes &types = javaTypes;
+    jclass biqtClass, futureClass;
+    if (!(types.stringClass = global_class(env, "java/lang/String")) ||
+        !(types.listClass = global_class(env, "java/util/ArrayList")) ||
+        !(types.providerInfoClass =
+              global_class(env, "org/mitre/biqt/ProviderInfo")) ||
+        !(types.resultClass =
+              global_class(env, "org/mitre/biqt/EvaluationResult")) ||
+        !(types.mapInterface = global_class(env, "java/util/Map")) ||
+        !(types.mapClass = global_class(env, "java/util/LinkedHashMap")))
+        return false;
+    if (!(biqtClass = jni_get_class(env, "org/mitre/biqt/BIQT")))
+        return false;
+    types.biqtPtr = env->GetFieldID(biqtClass, "biqt_ptr", "J");
+    env->DeleteLocalRef(biqtClass);
+    if (!types.biqtPtr)
+        return false;
+    if (!(futureClass = jni_get_class(
+              env, "java/util/concurrent/CompletableFuture")))
+        return false;
+    types.futureComplete = jni_get_method(env, futureClass, "complete",
+                                          "(Ljava/lang/Object;)Z");
+    types.futureCompleteExceptionally = jni_get_method(
+        env, futureClass, "completeExceptionally", "(Ljava/lang/Throwable;)Z");
+    env->DeleteLocalRef(futureClass);
+    types.listConstructor =
+        jni_get_method(env, types.listClass, "<init>", "()V");
+    types.listAdd =
+        jni_get_method(env, types.listClass, "add", "(Ljava/lang/Object;)Z");
+    types.providerInfoConstructor =
+        jni_get_method(env, types.providerInfoClass, "<init>",
+                       "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/"
+                       "String;Ljava/lang/String;)V");
+    types.resultConstructor = jni_get_method(
+        env, types.resultClass, "<init>",
+        "(Ljava/lang/String;ILjava/lang/String;[Ljava/lang/String;II[D[Z)V");
+    types.mapConstructor =
+        jni_get_method(env, types.mapClass, "<init>", "()V");
+    types.mapPut = jni_get_method(
+        env, types.mapClass, "put",
+        "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
+    return types.futureComplete && types.futureCompleteExceptionally &&
+           types.listConstructor && types.listAdd &&
+           types.providerInfoConstructor && types.resultConstructor &&
+           types.mapConstructor && types.mapPut;
+}
+
+void unload_java_types(JNIEnv *env)
+{
+    jclass *classes[] = {&javaTypes.stringClass, &javaTypes.listClass,
+                         &javaTypes.providerInfoClass, &javaTypes.resultClass,
+                         &javaTypes.mapInterface, &javaTypes.mapClass};
+    for (jclass *cls : classes) {
+        if (*cls) {
+            env->DeleteGlobalRef(*cls);
+            *cls = nullptr;
+        }
+    }
+}
+
+/**
+ * Gets the native BIQT object of a Java BIQT object.
+ */
+BIQT *get_app(JNIEnv *env, jobject biqt)
+{
+    return (BIQT *)(intptr_t)env->GetLongField(biqt, javaTypes.biqtPtr);
+}
+
+void set_app(JNIEnv *env, jobject biqt, BIQT *app)
+{
+    env->SetLongField(biqt, javaTypes.biqtPtr, (jlong)(intptr_t)app);
+}
+
+/* The native BIQT shared by every Java BIQT object, so that BIQT_HOME is
+ * scanned and each provider loaded once per process. It is destroyed when
+ * the last Java object is cleaned up. */
+std::mutex registryLock;
+BIQT *sharedApp = nullptr;
+size_t sharedAppUsers = 0;
+
+BIQT *acquire_app()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    if (!sharedApp) {
+        sharedApp = new BIQT();
+    }
+    sharedAppUsers++;
+    return sharedApp;
+}
+
+void release_app(BIQT *app)
+{
+    {
+        std::lock_guard<std::mutex> guard(registryLock);
+        if (app != sharedApp || --sharedAppUsers > 0) {
+            return;
+        }
+        sharedApp = nullptr;
+    }
+    // Deleting waits for pending asynchronous evaluations, whose callbacks
+    // may create a new Java BIQT, so the lock is not held here. A callback
+    // which releases the last Java BIQT runs on a native worker thread, which
+    // the deletion would wait for, so the deletion is handed to a new thread.
+    if (app->onWorkerThread()) {
+        std::thread([app] { delete app; }).detach();
+        return;
+    }
+    delete app;
+}
+
+/**
+ * Builds Java EvaluationResult objects directly from native results. The key
+ * strings are created once per builder and shared by every result it builds.
+ */
+class ResultBuilder {
+
+  public:
+    ResultBuilder(JNIEnv *env, const JavaTypes &types)
+        : env(env), stringClass(types.stringClass),
+          resultClass(types.resultClass),
+          resultConstructor(types.resultConstructor), types(types)
+    {
+    }
+
+    /**
+     * @return A local reference to a new Map from provider name to
+     * EvaluationResult, or null if an exception is pending.
+     */
+    jobject buildMap(
+        const std::map<std::string, Provider::EvaluationResult> &results)
+    {
+        jobject map =
+            this->env->NewObject(this->types.mapClass, this->types.mapConstructor);
+        if (!map) {
+            return nullptr;
+        }
+        for (const auto &iter : results) {
+            jobject jresult = this->build(iter.second);
+            if (!jresult) {
+                this->env->DeleteLocalRef(map);
+                return nullptr;
+            }
+            jstring name = this->env->NewStringUTF(iter.first.c_str());
+            this->env->DeleteLocalRef(this->env->CallObjectMethod(
+                map, this->types.mapPut, name, jresult));
+            this->env->DeleteLocalRef(name);
+            this->env->DeleteLocalRef(jresult);
+        }
+        return map;
+    }
+
+    /**
+     * @return A local reference to the new EvaluationResult, or null if an
+     * exception is pending.
+     */
+    jobject build(const Provider::EvaluationResult &result)
+    {
+        std::set<std::string> metrics, features;
+        for (const auto &quality : result.qualityResult) {
+            for (const auto &metric : quality.metrics) {
+                metrics.insert(metric.first);
+            }
+            for (const auto &feature : quality.features) {
+                features.insert(feature.first);
+            }
+        }
+        std::vector<std::string> names(metrics.begin(), metrics.end());
+        names.insert(names.end(), features.begin(), features.end());
+        size_t width = names.size();
+
+        // Detections need not report every key, so each value has a flag
+        // which tells whether it was reported. Any double, NaN included, is
+        // a valid value.
+        std::vector<double> values(width * result.qualityResult.size());
+        std::vector<jboolean> present(values.size(), JNI_FALSE);
+        size_t row = 0;
+        for (const auto &quality : result.qualityResult) {
+            for (const auto &metric : quality.metrics) {
+                size_t k = row + std::distance(metrics.begin(),
+                                               metrics.find(metric.first));
+                values[k] = metric.second;
+                present[k] = JNI_TRUE;
+            }
+            for (const auto &feature : quality.features) {
+                size_t k = row + metrics.size() +
+                           std::distance(features.begin(),
+                                         features.find(feature.first));
+                values[k] = feature.second;
+                present[k] = JNI_TRUE;
+            }
+            row += width;
+        }
+
+        jobjectArray jkeys =
+            this->env->NewObjectArray((jsize)width, this->stringClass, NULL);
+        jdoubleArray jvalues = this->env->NewDoubleArray((jsize)values.size());
+        jbooleanArray jpresent =
+            this->env->NewBooleanArray((jsize)present.size());
+        if (!jkeys || !jvalues || !jpresent) {
+            return nullptr;
+        }
+        for (size_t k = 0; k < width; k++) {
+            this->env->SetObjectArrayElement(jkeys, (jsize)k, this->key(names[k]));
+        }
+        this->env->SetDoubleArrayRegion(jvalues, 0, (jsize)values.size(),
+                                        values.data());
+        this->env->SetBooleanArrayRegion(jpresent, 0, (jsize)present.size(),
+                                         present.data());
+        jstring provider = this->env->NewStringUTF(result.provider.c_str());
+        jstring message = this->env->NewStringUTF(result.message.c_str());
+        jobject jresult = this->env->NewObject(
+            this->resultClass, this->resultConstructor, provider,
+            (jint)result.errorCode, message, jkeys, (jint)metrics.size(),
+            (jint)result.qualityResult.size(), jvalues, jpresent);
+        this->env->DeleteLocalRef(provider);
+        this->env->DeleteLocalRef(message);
+        this->env->DeleteLocalRef(jkeys);
+        this->env->DeleteLocalRef(jvalues);
+        this->env->DeleteLocalRef(jpresent);
+        return jresult;
+    }
+
+    /**
+     * Throws a RuntimeException.
+     *
+     * @return null, with the exception pending.
+     */
+    jobject error(const std::string &message)
+    {
+        jni_throw_exception(this->env, "java/lang/RuntimeException",
+                            message.c_str());
+        return nullptr;
+    }
+
+  private:
+    jstring key(const std::string &name)
+    {
+        auto cached = this->keys.find(name);
+        if (cached != this->keys.end()) {
+            return cached->second;
+        }
+        this->env->EnsureLocalCapacity(1);
+        jstring jname = this->env->NewStringUTF(name.c_str());
+        this->keys[name] = jname;
+        return jname;
+    }
+
+    JNIEnv *env;
+    jclass stringClass;
+    jclass resultClass;
+    jmethodID resultConstructor;
+    const JavaTypes &types;
+    std::map<std::string, jstring> keys;
+};
+
+/**
+ * Gets the JNIEnv of the current thread, attaching it to the JVM as a daemon
+ * thread if needed. Threads attached here are detached when they exit.
+ */
+JNIEnv *attach_thread(JavaVM *jvm)
+{
+    struct Attachment {
+        JavaVM *jvm = nullptr;
+        ~Attachment()
+        {
+            if (this->jvm) {
+                this->jvm->DetachCurrentThread();
+            }
+        }
+    };
+    static thread_local Attachment attachment;
+
+    JNIEnv *env = nullptr;
+    if (jvm->GetEnv((void **)&env, JNI_VERSION_1_8) == JNI_OK) {
+        return env;
+    }
+    if (jvm->AttachCurrentThreadAsDaemon((void **)&env, NULL) != JNI_OK) {
+        return nullptr;
+    }
+    attachment.jvm = jvm;
+    return env;
+}
+
+/**
+ * Completes a Java CompletableFuture from a native thread. The future is held
+ * as a global reference until the delivery is destroyed.
+ */
+class FutureDelivery {
+
+  public:
+    FutureDelivery(JNIEnv *env, jobject future, const JavaTypes &types)
+        : future(env->NewGlobalRef(future)), types(types)
+    {
+        env->GetJavaVM(&this->jvm);
+    }
+
+    ~FutureDelivery()
+    {
+        JNIEnv *env = attach_thread(this->jvm);
+        if (env) {
+            env->DeleteGlobalRef(this->future);
+        }
+    }
+
+    FutureDelivery(const FutureDelivery &) = delete;
+    FutureDelivery &operator=(const FutureDelivery &) = delete;
+
+    /**
+     * Completes the future with the object returned by build, or
+     * exceptionally with the exception it leaves pending.
+     */
+    template <typename Build> void complete(Build build)
+    {
+        JNIEnv *env = attach_thread(this->jvm);
+        if (!env) {
+            std::cerr << "Unable to attach a BIQT worker thread to the JVM."
+                      << std::endl;
+            return;
+        }
+        if (env->PushLocalFrame(16) < 0) {
+            return;
+        }
+        ResultBuilder builder(env, this->types);
+        jobject value = build(builder);
+        jthrowable error = env->ExceptionOccurred();
+        if (error) {
+            env->ExceptionClear();
+            env->CallBooleanMethod(this->future,
+                                   this->types.futureCompleteExceptionally,
+                                   error);
+        }
+        else {
+            env->CallBooleanMethod(this->future, this->types.futureComplete,
+                                   value);
+        }
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+        }
+        env->PopLocalFrame(NULL);
+    }
+
+  private:
+    JavaVM *jvm;
+    jobject future;
+    const JavaTypes &types;
+};
+
+/**
+ * Keeps the memory of a direct ByteBuffer alive with a global reference. An
+ * evaluation which outlives its time limit may release it last, on a native
+ * thread.
+ *
+ * @return The owner, or nullptr if no reference could be created.
+ */
+std::shared_ptr<const void> hold_direct(JNIEnv *env, jobject buffer)
+{
+    JavaVM *jvm = nullptr;
+    jobject ref = nullptr;
+    if (env->GetJavaVM(&jvm) != JNI_OK ||
+        !(ref = env->NewGlobalRef(buffer))) {
+        return nullptr;
+    }
+    return std::shared_ptr<const void>(ref, [jvm](jobject ref) {
+        JNIEnv *env = attach_thread(jvm);
+        if (env) {
+            env->DeleteGlobalRef(ref);
+        }
+    });
+}
+
+/**
+ * Keeps the elements of a byte array, as returned by GetByteArrayElements,
+ * until the last evaluation using them is done, and then releases them
+ * without copying anything back.
+ *
+ * @return The owner, or nullptr if no reference could be created.
+ */
+std::shared_ptr<const void> hold_elements(JNIEnv *env, jbyteArray bytes,
+                                          jbyte *data)
+{
+    JavaVM *jvm = nullptr;
+    jbyteArray ref = nullptr;
+    if (env->GetJavaVM(&jvm) != JNI_OK ||
+        !(ref = (jbyteArray)env->NewGlobalRef(bytes))) {
+        return nullptr;
+    }
+    return std::shared_ptr<const void>(ref, [jvm, data](jbyteArray ref) {
+        JNIEnv *env = attach_thread(jvm);
+        if (env) {
+            env->ReleaseByteArrayElements(ref, data, JNI_ABORT);
+            env->DeleteGlobalRef(ref);
+        }
+    });
+}
+
+/**
+ * Runs a provider, or all providers of a modality, on bytes in memory and
+ * builds the typed Java result. Providers without a buffer entry point read
+ * the bytes from a temporary file.
+ *
+ * @param owner Keeps the bytes alive, so evaluations which outlive their
+ * time limit hold it instead of copying the bytes.
+ *
+ * @return An EvaluationResult, a Map from provider name to EvaluationResult,
+ * or null if a Java exception is pending.
+ */
+jobject evaluate_memory(JNIEnv *env, jobject biqt, jboolean modality,
+                        jstring jname, const unsigned char *data,
+                        size_t length, std::shared_ptr<const void> owner)
+{
+    BIQT *app = get_app(env, biqt);
+    const JavaTypes *types = &javaTypes;
+    const char *name = env->GetStringUTFChars(jname, NULL);
+    std::string nameStr(name);
+    env->ReleaseStringUTFChars(jname, name);
+
+    MappedInput input(data, length, "<memory>", std::move(owner));
+    ResultBuilder builder(env, *types);
+    if (modality) {
+        return builder.buildMap(app->runModality(nameStr, input));
+    }
+    return builder.build(app->runProvider(nameStr, input));
+}
+
+/**
+ * Copies the elements of a Java String array.
+ */
+std::vector<std::string> to_strings(JNIEnv *env, jobjectArray jstrings)
+{
+    jsize count = env->GetArrayLength(jstrings);
+    std::vector<std::string> strings;
+    strings.reserve(count);
+    for (jsize i = 0; i < count; i++) {
+        jstring jstr = (jstring)env->GetObjectArrayElement(jstrings, i);
+        const char *str = env->GetStringUTFChars(jstr, NULL);
+        strings.push_back(std::string(str));
+        env->ReleaseStringUTFChars(jstr, str);
+        env->DeleteLocalRef(jstr);
+    }
+    return strings;
+}
+
+/**
+ * Builds a Java String array, releasing each element's local reference as it
+ * is stored so that large batches do not exhaust the local reference table.
+ */
+jobjectArray to_java_strings(JNIEnv *env, const std::vector<std::string> &strings)
+{
+    jobjectArray jstrings = env->NewObjectArray(
+        (jsize)strings.size(), javaTypes.stringClass, NULL);
+    if (!jstrings)
+        return nullptr;
+    for (size_t i = 0; i < strings.size(); i++) {
+        jstring jstr = env->NewStringUTF(strings[i].c_str());
+        env->SetObjectArrayElement(jstrings, (jsize)i, jstr);
+        env->DeleteLocalRef(jstr);
+    }
+    return jstrings;
+}
+
+} // namespace
+
+/**
+ * Resolves the Java classes, fields and methods used by the native methods
+ * when the library is loaded.
+ *
+ * @param jvm The Java virtual machine
+ * @param reserved Unused
+ * @return The JNI version required, or JNI_ERR if a lookup failed.
+ */
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
+{
+    JNIEnv *env;
+    (void)reserved;
+    if (jvm->GetEnv((void **)&env, JNI_VERSION_1_8) != JNI_OK) {
+        return JNI_ERR;
+    }
+    if (!load_java_types(env)) {
+        unload_java_types(env);
+        return JNI_ERR;
+    }
+    return JNI_VERSION_1_8;
+}
+
+/**
+ * Releases the global references taken in JNI_OnLoad.
+ *
+ * @param jvm The Java virtual machine
+ * @param reserved Unused
+ */
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM *jvm, void *reserved)
+{
+    JNIEnv *env;
+    (void)reserved;
+    if (jvm->GetEnv((void **)&env, JNI_VERSION_1_8) == JNI_OK) {
+        unload_java_types(env);
+    }
+}
+
+/**
+ * Initializes a Java BIQT object. All Java BIQT objects share one native
+ * BIQT, which is created by the first of them.
  *
  * @param env The Java environment
  * @param biqt The Java BIQT object
@@ -23,8 +599,7 @@
 JNIEXPORT void JNICALL
 Java_org_mitre_biqt_BIQT_initialize(JNIEnv *env, jobject biqt)
 {
-    BIQT *app = new BIQT(); // create the object on the heap.
-    jni_set_pointer(env, biqt, "biqt_ptr", (void *)app);
+    set_app(env, biqt, acquire_app());
 }
 
 /**
@@ -34,41 +609,33 @@ Java_org_mitre_biqt_BIQT_initialize(JNIEnv *env, jobject biqt)
  * @param biqt The Java BIQT object
  */
 JNIEXPORT jobject JNICALL
-Java_org_mitre_biqt_BIQT_getProviders(JNIEnv *env, jobject biqt)
+Java_org_mitre_biqt_BIQT_loadProviders(JNIEnv *env, jobject biqt)
 {
     jstring name, version, description, modality;
-    jclass piClass, listClass;
-    jmethodID piConstructor, listConstructor, listAdd;
     jobject providerInfo, list;
 
-    BIQT *app = (BIQT *)jni_get_pointer(env, biqt, "biqt_ptr");
+    BIQT *app = get_app(env, biqt);
     std::vector<ProviderInfo *> providers = app->getProviders();
 
-    listClass = jni_get_class(env, "java/util/ArrayList");
-    piClass = jni_get_class(env, "org/mitre/biqt/ProviderInfo");
-
-    if (!(listConstructor = jni_get_method(env, listClass, "<init>", "()V")))
-        return nullptr;
-    if (!(listAdd =
-              jni_get_method(env, listClass, "add", "(Ljava/lang/Object;)Z")))
-        return nullptr;
-    if (!(piConstructor =
-              jni_get_method(env, piClass, "<init>",
-                             "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/"
-                             "String;Ljava/lang/String;)V")))
+    list = env->NewObject(javaTypes.listClass, javaTypes.listConstructor);
+    if (!list)
         return nullptr;
 
-    list = env->NewObject(listClass, listConstructor);
-
     for (const auto p : providers) {
         // iterate through each provider and insert them into an ArrayList
         name = env->NewStringUTF(p->name.c_str());
         version = env->NewStringUTF(p->version.c_str());
         description = env->NewStringUTF(p->description.c_str());
         modality = env->NewStringUTF(p->modality.c_str());
-        providerInfo = env->NewObject(piClass, piConstructor, name, version,
-                                      description, modality);
-        env->CallBooleanMethod(list, listAdd, providerInfo);
+        providerInfo = env->NewObject(javaTypes.providerInfoClass,
+                                      javaTypes.providerInfoConstructor, name,
+                                      version, description, modality);
+        env->CallBooleanMethod(list, javaTypes.listAdd, providerInfo);
+        env->DeleteLocalRef(name);
+        env->DeleteLocalRef(version);
+        env->DeleteLocalRef(description);
+        env->DeleteLocalRef(modality);
+        env->DeleteLocalRef(providerInfo);
     }
     return list;
 }
@@ -87,7 +654,7 @@ JNIEXPORT jstring JNICALL Java_org_mitre_biqt_BIQT_runProvider(
     const char *provider;
     const char *inputFile;
     Provider::EvaluationResult result;
-    BIQT *app = (BIQT *)jni_get_pointer(env, biqt, "biqt_ptr");
+    BIQT *app = get_app(env, biqt);
 
     /* Get the strings from the java types */
     provider = env->GetStringUTFChars(jprovider, NULL);
@@ -119,24 +686,15 @@ JNIEXPORT jstring JNICALL Java_org_mitre_biqt_BIQT_runModality(
 {
     const char *modality;
     const char *inputFile;
-    std::string resultStr;
     std::map<std::string, Provider::EvaluationResult> result;
-    BIQT *app = (BIQT *)jni_get_pointer(env, biqt, "biqt_ptr");
+    BIQT *app = get_app(env, biqt);
 
     /* Get the strings from the java types */
     modality = env->GetStringUTFChars(jmodality, NULL);
     inputFile = env->GetStringUTFChars(jinputFile, NULL);
 
     result = app->runModality(std::string(modality), std::string(inputFile));
-    for (const auto &iter : result) {
-        if (resultStr.length()) {
-            resultStr = resultStr + ",";
-        }
-        char* serialized_result = Provider::serializeResult(iter.second);
-        resultStr = resultStr + serialized_result;
-        delete[] serialized_result;
-    }
-    jstring jresult = env->NewStringUTF(resultStr.c_str());
+    jstring jresult = env->NewStringUTF(serialize_modality(result).c_str());
 
     /* Release the strings back to java */
     env->ReleaseStringUTFChars(jmodality, modality);
@@ -144,9 +702,296 @@ JNIEXPORT jstring JNICALL Java_org_mitre_biqt_BIQT_runModality(
     return jresult;
 }
 
+/**
+ * Runs a provider on a list of files. The files are evaluated in parallel in
+ * native code and all results are returned together.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param jprovider A Java String containing the provider name.
+ * @param jinputFiles A Java String array containing the input files.
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_runProviderBatch(
+    JNIEnv *env, jobject biqt, jstring jprovider, jobjectArray jinputFiles)
+{
+    BIQT *app = get_app(env, biqt);
+    const char *provider = env->GetStringUTFChars(jprovider, NULL);
+    std::string providerName(provider);
+    env->ReleaseStringUTFChars(jprovider, provider);
+    std::vector<std::string> inputFiles = to_strings(env, jinputFiles);
+
+    std::vector<Provider::EvaluationResult> results =
+        app->runProviderBatch(providerName, inputFiles);
+    std::vector<std::string> serialized;
+    serialized.reserve(results.size());
+    for (const auto &result : results) {
+        std::unique_ptr<char[]> resultStr(Provider::serializeResult(result));
+        serialized.push_back(std::string(resultStr.get()));
+    }
+    return to_java_strings(env, serialized);
+}
+
+/**
+ * Runs all providers with the given modality on a list of files. The files
+ * are evaluated in parallel in native code and all results are returned
+ * together.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param jmodality A Java String containing the modality of the provider(s) to
+ * run
+ * @param jinputFiles A Java String array containing the input files.
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_runModalityBatch(
+    JNIEnv *env, jobject biqt, jstring jmodality, jobjectArray jinputFiles)
+{
+    BIQT *app = get_app(env, biqt);
+    const char *modality = env->GetStringUTFChars(jmodality, NULL);
+    std::string modalityName(modality);
+    env->ReleaseStringUTFChars(jmodality, modality);
+    std::vector<std::string> inputFiles = to_strings(env, jinputFiles);
+
+    std::vector<std::map<std::string, Provider::EvaluationResult>> results =
+        app->runModalityBatch(modalityName, inputFiles);
+    std::vector<std::string> serialized;
+    serialized.reserve(results.size());
+    for (const auto &result : results) {
+        serialized.push_back(serialize_modality(result));
+    }
+    return to_java_strings(env, serialized);
+}
+
+/**
+ * Runs a provider on a list of files and returns typed results, built in
+ * native code without a JSON round trip.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param jprovider A Java String containing the provider name.
+ * @param jinputFiles A Java String array containing the input files.
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_evaluateProviderBatch(
+    JNIEnv *env, jobject biqt, jstring jprovider, jobjectArray jinputFiles)
+{
+    BIQT *app = get_app(env, biqt);
+    const JavaTypes *types = &javaTypes;
+    ResultBuilder builder(env, *types);
+    const char *provider = env->GetStringUTFChars(jprovider, NULL);
+    std::string providerName(provider);
+    env->ReleaseStringUTFChars(jprovider, provider);
+    std::vector<std::string> inputFiles = to_strings(env, jinputFiles);
+
+    std::vector<Provider::EvaluationResult> results =
+        app->runProviderBatch(providerName, inputFiles);
+    jobjectArray jresults = env->NewObjectArray(
+        (jsize)results.size(), types->resultClass, NULL);
+    if (!jresults)
+        return nullptr;
+    for (size_t i = 0; i < results.size(); i++) {
+        jobject jresult = builder.build(results[i]);
+        if (!jresult)
+            return nullptr;
+        env->SetObjectArrayElement(jresults, (jsize)i, jresult);
+        env->DeleteLocalRef(jresult);
+    }
+    return jresults;
+}
+
+/**
+ * Runs all providers with the given modality on a list of files and returns,
+ * for each file, a Map from provider name to typed result.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param jmodality A Java String containing the modality of the provider(s) to
+ * run
+ * @param jinputFiles A Java String array containing the input files.
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_evaluateModalityBatch(
+    JNIEnv *env, jobject biqt, jstring jmodality, jobjectArray jinputFiles)
+{
+    BIQT *app = get_app(env, biqt);
+    const JavaTypes *types = &javaTypes;
+    ResultBuilder builder(env, *types);
+
+    const char *modality = env->GetStringUTFChars(jmodality, NULL);
+    std::string modalityName(modality);
+    env->ReleaseStringUTFChars(jmodality, modality);
+    std::vector<std::string> inputFiles = to_strings(env, jinputFiles);
+
+    std::vector<std::map<std::string, Provider::EvaluationResult>> results =
+        app->runModalityBatch(modalityName, inputFiles);
+    jobjectArray jresults = env->NewObjectArray(
+        (jsize)results.size(), types->mapInterface, NULL);
+    if (!jresults)
+        return nullptr;
+    for (size_t i = 0; i < results.size(); i++) {
+        jobject map = builder.buildMap(results[i]);
+        if (!map)
+            return nullptr;
+        env->SetObjectArrayElement(jresults, (jsize)i, map);
+        env->DeleteLocalRef(map);
+    }
+    return jresults;
+}
+
+/**
+ * Runs a provider on a native worker thread and completes a Java
+ * CompletableFuture with the EvaluationResult.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param jprovider A Java String containing the provider name.
+ * @param jinputFile A Java String containing the input file for the provider.
+ * @param future The CompletableFuture to complete.
+ */
+JNIEXPORT void JNICALL Java_org_mitre_biqt_BIQT_submitProvider(
+    JNIEnv *env, jobject biqt, jstring jprovider, jstring jinputFile,
+    jobject future)
+{
+    BIQT *app = get_app(env, biqt);
+    const JavaTypes *types = &javaTypes;
+    const char *provider = env->GetStringUTFChars(jprovider, NULL);
+    const char *inputFile = env->GetStringUTFChars(jinputFile, NULL);
+    std::shared_ptr<FutureDelivery> delivery(
+        new FutureDelivery(env, future, *types));
+
+    app->runProviderAsync(
+        std::string(provider), std::string(inputFile),
+        [delivery](const Provider::EvaluationResult &result) {
+            delivery->complete(
+                [&result](ResultBuilder &builder) { return builder.build(result); });
+        });
+
+    env->ReleaseStringUTFChars(jprovider, provider);
+    env->ReleaseStringUTFChars(jinputFile, inputFile);
+}
+
+/**
+ * Runs all providers with the given modality on a native worker thread and
+ * completes a Java CompletableFuture with a Map from provider name to
+ * EvaluationResult, or exceptionally if the providers could not be run.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param jmodality A Java String containing the modality of the provider(s) to
+ * run
+ * @param jinputFile A Java String containing the path to the input file to
+ * analyze
+ * @param future The CompletableFuture to complete.
+ */
+JNIEXPORT void JNICALL Java_org_mitre_biqt_BIQT_submitModality(
+    JNIEnv *env, jobject biqt, jstring jmodality, jstring jinputFile,
+    jobject future)
+{
+    BIQT *app = get_app(env, biqt);
+    const JavaTypes *types = &javaTypes;
+    const char *modality = env->GetStringUTFChars(jmodality, NULL);
+    const char *inputFile = env->GetStringUTFChars(jinputFile, NULL);
+    std::shared_ptr<FutureDelivery> delivery(
+        new FutureDelivery(env, future, *types));
+
+    app->runModalityAsync(
+        std::string(modality), std::string(inputFile),
+        [delivery](
+            const std::map<std::string, Provider::EvaluationResult> &results) {
+            delivery->complete([&results](ResultBuilder &builder) {
+                return builder.buildMap(results);
+            });
+        },
+        [delivery](const std::string &error) {
+            delivery->complete([&error](ResultBuilder &builder) {
+                return builder.error("Unable to run the providers: " + error);
+            });
+        });
+
+    env->ReleaseStringUTFChars(jmodality, modality);
+    env->ReleaseStringUTFChars(jinputFile, inputFile);
+}
+
+/**
+ * Runs a provider, or all providers of a modality, on the contents of a
+ * direct ByteBuffer. Providers with a buffer entry point read the Java
+ * memory in place.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param modality Whether jname is a modality rather than a provider name.
+ * @param jname A Java String containing the provider name or modality.
+ * @param buffer A direct ByteBuffer containing the encoded image.
+ * @param offset The index of the first byte of the image in buffer.
+ * @param length The number of bytes in the image.
+ */
+JNIEXPORT jobject JNICALL Java_org_mitre_biqt_BIQT_evaluateDirect(
+    JNIEnv *env, jobject biqt, jboolean modality, jstring jname,
+    jobject buffer, jint offset, jint length)
+{
+    unsigned char *data = (unsigned char *)env->GetDirectBufferAddress(buffer);
+    if (!data) {
+        jni_throw_exception(env, "java/lang/IllegalArgumentException",
+                            "The ByteBuffer is not a direct buffer.");
+        return nullptr;
+    }
+    if (offset < 0 || length < 0 ||
+        (jlong)offset + length > env->GetDirectBufferCapacity(buffer)) {
+        jni_throw_exception(env, "java/lang/IndexOutOfBoundsException",
+                            "The image extends beyond the ByteBuffer.");
+        return nullptr;
+    }
+    return evaluate_memory(env, biqt, modality, jname, data + offset,
+                           (size_t)length, hold_direct(env, buffer));
+}
+
+/**
+ * Runs a provider, or all providers of a modality, on the contents of a byte
+ * array.
+ *
+ * The array is not held with GetPrimitiveArrayCritical because evaluations
+ * may run for a long time, which would stall the garbage collector, and Java
+ * providers call back into the JVM. Depending on the JVM the elements may be
+ * copied; direct ByteBuffers are never copied. The elements are released by
+ * the last evaluation using them, which may outlive this call when a provider
+ * exceeds its time limit.
+ *
+ * @param env The Java environment
+ * @param biqt The Java BIQT object
+ * @param modality Whether jname is a modality rather than a provider name.
+ * @param jname A Java String containing the provider name or modality.
+ * @param bytes A Java byte array containing the encoded image.
+ * @param offset The index of the first byte of the image in bytes.
+ * @param length The number of bytes in the image.
+ */
+JNIEXPORT jobject JNICALL Java_org_mitre_biqt_BIQT_evaluateBytes(
+    JNIEnv *env, jobject biqt, jboolean modality, jstring jname,
+    jbyteArray bytes, jint offset, jint length)
+{
+    if (offset < 0 || length < 0 ||
+        (jlong)offset + length > env->GetArrayLength(bytes)) {
+        jni_throw_exception(env, "java/lang/IndexOutOfBoundsException",
+                            "The image extends beyond the byte array.");
+        return nullptr;
+    }
+    jbyte *data = env->GetByteArrayElements(bytes, NULL);
+    if (!data)
+        return nullptr;
+    /* Providers only read the input, so nothing is copied back. */
+    std::shared_ptr<const void> owner = hold_elements(env, bytes, data);
+    if (!owner) {
+        env->ReleaseByteArrayElements(bytes, data, JNI_ABORT);
+        jni_throw_exception(env, "java/lang/OutOfMemoryError",
+                            "Unable to hold the byte array.");
+        return nullptr;
+    }
+    return evaluate_memory(env, biqt, modality, jname,
+                           (const unsigned char *)data + offset,
+                           (size_t)length, std::move(owner));
+}
+
 /**
  * Cleans up any allocated memory. This should only be called when you are
- * finished with the Java BIQT object.
+ * finished with the Java BIQT object. The shared native BIQT is destroyed
+ * with the last Java BIQT object, after its pending asynchronous evaluations
+ * are completed.
  *
  * @param env The Java environment
  * @param biqt The Java BIQT object
@@ -154,7 +999,9 @@ JNIEXPORT jstring JNICALL Java_org_mitre_biqt_BIQT_runModality(
 JNIEXPORT void JNICALL Java_org_mitre_biqt_BIQT_cleanup(JNIEnv *env,
                                                                  jobject biqt)
 {
-    BIQT *app = (BIQT *)jni_get_pointer(env, biqt, "biqt_ptr");
-    delete app;
-    jni_set_pointer(env, biqt, "biqt_ptr", (void *)NULL);
+    BIQT *app = get_app(env, biqt);
+    set_app(env, biqt, nullptr);
+    if (app) {
+        release_app(app);
+    }
 }
@@ -27,11 +27,11 @@ JNIEXPORT void JNICALL Java_org_mitre_biqt_BIQT_initialize(JNIEnv *,
 
 /*
  * Class:     org_mitre_biqt_BIQT
- * Method:    getProviders
- * Signature: ()Ljava/lang/Object;
+ * Method:    loadProviders
+ * Signature: ()Ljava/util/List;
  */
 JNIEXPORT jobject JNICALL
-Java_org_mitre_biqt_BIQT_getProviders(JNIEnv *env, jobject biqt);
+Java_org_mitre_biqt_BIQT_loadProviders(JNIEnv *env, jobject biqt);
 
 /*
  * Class:     org_mitre_biqt_BIQT
@@ -49,6 +49,70 @@ JNIEXPORT jstring JNICALL Java_org_mitre_biqt_BIQT_runProvider(
 JNIEXPORT jstring JNICALL Java_org_mitre_biqt_BIQT_runModality(
     JNIEnv *, jobject, jstring, jstring);
 
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    runProviderBatch
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_runProviderBatch(
+    JNIEnv *, jobject, jstring, jobjectArray);
+
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    runModalityBatch
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_runModalityBatch(
+    JNIEnv *, jobject, jstring, jobjectArray);
+
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    evaluateProviderBatch
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;)[Lorg/mitre/biqt/EvaluationResult;
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_evaluateProviderBatch(
+    JNIEnv *, jobject, jstring, jobjectArray);
+
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    evaluateModalityBatch
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;)[Ljava/util/Map;
+ */
+JNIEXPORT jobjectArray JNICALL Java_org_mitre_biqt_BIQT_evaluateModalityBatch(
+    JNIEnv *, jobject, jstring, jobjectArray);
+
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    submitProvider
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/util/concurrent/CompletableFuture;)V
+ */
+JNIEXPORT void JNICALL Java_org_mitre_biqt_BIQT_submitProvider(
+    JNIEnv *, jobject, jstring, jstring, jobject);
+
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    submitModality
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/util/concurrent/CompletableFuture;)V
+ */
+JNIEXPORT void JNICALL Java_org_mitre_biqt_BIQT_submitModality(
+    JNIEnv *, jobject, jstring, jstring, jobject);
+
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    evaluateDirect
+ * Signature: (ZLjava/lang/String;Ljava/nio/ByteBuffer;II)Ljava/lang/Object;
+ */
+JNIEXPORT jobject JNICALL Java_org_mitre_biqt_BIQT_evaluateDirect(
+    JNIEnv *, jobject, jboolean, jstring, jobject, jint, jint);
+
+/*
+ * Class:     org_mitre_biqt_BIQT
+ * Method:    evaluateBytes
+ * Signature: (ZLjava/lang/String;[BII)Ljava/lang/Object;
+ */
+JNIEXPORT jobject JNICALL Java_org_mitre_biqt_BIQT_evaluateBytes(
+    JNIEnv *, jobject, jboolean, jstring, jbyteArray, jint, jint);
+
 /*
  * Class:     org_mitre_biqt_BIQT
  * Method:    cleanup
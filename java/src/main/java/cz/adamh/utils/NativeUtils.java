@@ -24,12 +24,21 @@
 package cz.adamh.utils;
 
 import java.io.*;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.channels.FileLock;
 import java.nio.file.FileSystemNotFoundException;
 import java.nio.file.FileSystems;
 import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
 import java.nio.file.ProviderNotFoundException;
 import java.nio.file.StandardCopyOption;
+import java.nio.file.StandardOpenOption;
 import java.nio.file.attribute.PosixFilePermission;
+import java.nio.file.attribute.PosixFilePermissions;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
 import java.util.EnumSet;
 import java.util.Set;
 
@@ -56,6 +65,12 @@ public class NativeUtils {
    */
   private static File temporaryDir;
 
+  /**
+   * System property which overrides the directory where extracted libraries
+   * are cached.
+   */
+  public static final String CACHE_PROPERTY = "biqt.native.cache";
+
   /**
    * Private constructor - this class will never be instanced
    */
@@ -64,9 +79,20 @@ public class NativeUtils {
   /**
    * Loads library from current JAR archive
    *
-   * The file from JAR is copied into system temporary directory and then
-   * loaded. The temporary file is deleted after exiting. Method uses String as
-   * filename because the pathname is "abstract", not system-dependent.
+   * The file from JAR is extracted once into a per-user cache directory, in a
+   * subdirectory named after the SHA-256 hash of its contents, and later
+   * starts load it from there. A cached file is only used if its hash still
+   * matches. Extraction writes a temporary file and renames it into place
+   * while holding a file lock, so concurrent starts never load a partially
+   * written library. The cache directory is {@code $XDG_CACHE_HOME/biqt/native}
+   * or {@code ~/.cache/biqt/native} ({@code %LOCALAPPDATA%\biqt\native} on
+   * Windows), and may be set with the {@value #CACHE_PROPERTY} system
+   * property.
+   *
+   * If the cache cannot be used, the file is copied into system temporary
+   * directory and then loaded. The temporary file is deleted after exiting.
+   * Method uses String as filename because the pathname is "abstract", not
+   * system-dependent.
    *
    * @param path The path of file inside JAR as absolute path (beginning with
    * '/'), e.g. /package/File.ext
@@ -96,6 +122,21 @@ public class NativeUtils {
           "The filename has to be at least 3 characters long.");
     }
 
+    byte[] content;
+    try (InputStream is = NativeUtils.class.getResourceAsStream(path)) {
+      if (is == null) {
+        throw new FileNotFoundException("File " + path +
+                                        " was not found inside JAR.");
+      }
+      content = readAll(is);
+    }
+
+    File cached = extractToCache(filename, content);
+    if (cached != null) {
+      System.load(cached.getAbsolutePath());
+      return;
+    }
+
     // Prepare temporary file
     if (temporaryDir == null) {
       temporaryDir = createTempDirectory("nativeutils");
@@ -104,12 +145,8 @@ public class NativeUtils {
 
     File temp = new File(temporaryDir, filename);
 
-    try (InputStream is = NativeUtils.class.getResourceAsStream(path)) {
-      if (is == null) {
-        throw new FileNotFoundException("File " + path +
-                                        " was not found inside JAR.");
-      }
-      Files.copy(is, temp.toPath(), StandardCopyOption.REPLACE_EXISTING);
+    try {
+      Files.write(temp.toPath(), content);
     } catch (IOException e) {
       temp.delete();
       throw e;
@@ -128,6 +165,133 @@ public class NativeUtils {
     }
   }
 
+  /**
+   * Finds or creates the cached copy of a library.
+   *
+   * @param filename The file name of the library
+   * @param content The contents of the library
+   * @return The cached file, or null if the cache cannot be used.
+   */
+  private static synchronized File extractToCache(String filename,
+                                                  byte[] content) {
+    try {
+      Path root = cacheDirectory();
+      if (root == null) {
+        return null;
+      }
+      String hash = sha256(content);
+      Path dir = root.resolve(hash);
+      Path target = dir.resolve(filename);
+      if (isIntact(target, hash)) {
+        return target.toFile();
+      }
+      createPrivateDirectory(dir);
+      try (FileChannel channel = FileChannel.open(
+               dir.resolve(filename + ".lock"), StandardOpenOption.CREATE,
+               StandardOpenOption.WRITE);
+           FileLock lock = channel.lock()) {
+        // Another process may have extracted the file while we waited.
+        if (isIntact(target, hash)) {
+          return target.toFile();
+        }
+        Path partial = Files.createTempFile(dir, filename, ".part");
+        try {
+          try (FileChannel out = FileChannel.open(
+                   partial, StandardOpenOption.WRITE,
+                   StandardOpenOption.TRUNCATE_EXISTING)) {
+            out.write(ByteBuffer.wrap(content));
+            out.force(true);
+          }
+          if (isPosixCompliant()) {
+            Files.setPosixFilePermissions(
+                partial, PosixFilePermissions.fromString("r-x------"));
+          }
+          Files.move(partial, target, StandardCopyOption.ATOMIC_MOVE,
+                     StandardCopyOption.REPLACE_EXISTING);
+        } finally {
+          Files.deleteIfExists(partial);
+        }
+        return isIntact(target, hash) ? target.toFile() : null;
+      }
+    } catch (IOException | SecurityException | UnsupportedOperationException e) {
+      // AtomicMoveNotSupportedException is an IOException as well.
+      return null;
+    }
+  }
+
+  /**
+   * Gets the per-user cache directory, creating it if needed.
+   *
+   * @return The directory, or null if it is not owned by the current user.
+   */
+  private static Path cacheDirectory() throws IOException {
+    String configured = System.getProperty(CACHE_PROPERTY);
+    Path dir;
+    if (configured != null && !configured.isEmpty()) {
+      dir = Paths.get(configured);
+    } else if (System.getenv("LOCALAPPDATA") != null &&
+               !isPosixCompliant()) {
+      dir = Paths.get(System.getenv("LOCALAPPDATA"), "biqt", "native");
+    } else if (System.getenv("XDG_CACHE_HOME") != null &&
+               !System.getenv("XDG_CACHE_HOME").isEmpty()) {
+      dir = Paths.get(System.getenv("XDG_CACHE_HOME"), "biqt", "native");
+    } else {
+      dir = Paths.get(System.getProperty("user.home"), ".cache", "biqt",
+                      "native");
+    }
+    createPrivateDirectory(dir);
+    // Refuse a directory which another user could have planted.
+    if (isPosixCompliant() &&
+        !Files.getOwner(dir).getName().equals(System.getProperty("user.name"))) {
+      return null;
+    }
+    return dir;
+  }
+
+  private static void createPrivateDirectory(Path dir) throws IOException {
+    if (Files.isDirectory(dir)) {
+      return;
+    }
+    Files.createDirectories(dir);
+    if (isPosixCompliant()) {
+      Files.setPosixFilePermissions(dir,
+                                    PosixFilePermissions.fromString("rwx------"));
+    }
+  }
+
+  /**
+   * Determines whether a cached file exists and has the expected contents.
+   */
+  private static boolean isIntact(Path file, String hash) throws IOException {
+    if (!Files.isRegularFile(file)) {
+      return false;
+    }
+    return sha256(Files.readAllBytes(file)).equals(hash);
+  }
+
+  private static String sha256(byte[] content) throws IOException {
+    try {
+      byte[] digest = MessageDigest.getInstance("SHA-256").digest(content);
+      StringBuilder hex = new StringBuilder(digest.length * 2);
+      for (byte b : digest) {
+        hex.append(String.format("%02x", b));
+      }
+      return hex.toString();
+    } catch (NoSuchAlgorithmException e) {
+      throw new IOException("SHA-256 is not available.", e);
+    }
+  }
+
+  private static byte[] readAll(InputStream is) throws IOException {
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    byte[] buffer = new byte[64 * 1024];
+    int n;
+    while ((n = is.read(buffer)) != -1) {
+      out.write(buffer, 0, n);
+    }
+    return out.toByteArray();
+  }
+
   private static boolean isPosixCompliant() {
     try {
       if (FileSystems.getDefault().supportedFileAttributeViews().contains(
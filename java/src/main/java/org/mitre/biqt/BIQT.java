@@ -11,9 +11,14 @@
 package org.mitre.biqt;
 
 import jakarta.annotation.PreDestroy;
+import java.util.Arrays;
+import java.util.Collections;
 import java.util.List;
+import java.util.Map;
 import java.util.ArrayList;
+import java.util.concurrent.CompletableFuture;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import org.json.simple.JSONObject;
 import org.json.simple.parser.JSONParser;
 import org.json.simple.parser.ParseException;
@@ -23,6 +28,19 @@ import cz.adamh.utils.NativeUtils;
 
 /**
  * A new instance of BIQT which can be used to run available providers.
+ *
+ * <p>All instances in a process share one native BIQT: providers are loaded
+ * by the first instance and unloaded when the last instance is destroyed, so
+ * creating further instances is cheap. Statistics are shared as well.
+ *
+ * <p>A BIQT instance may be shared by any number of threads; there is no need
+ * to create one per thread. Evaluations of C++ providers which are not marked
+ * "threadSafe" in their descriptor are serialized natively. The asynchronous
+ * methods run on a pool of native threads and never block the calling
+ * thread. Their futures are completed on a pool thread, so dependent stages
+ * added without an executor also run there and should not block. Destroying
+ * the last instance waits for pending asynchronous evaluations. An instance
+ * must not be used after {@link #destroy()}.
  */
 public class BIQT {
   private static final Logger logger = LoggerFactory.getLogger(BIQT.class);
@@ -51,20 +69,42 @@ public class BIQT {
   /** Used in native code for storing a pointer to a BIQT instance */
   private long biqt_ptr;
 
+  /** The providers, which do not change after the native BIQT is created */
+  private volatile List<ProviderInfo> providers;
+
   /**
    * Creates a new BIQT instance
    */
   public BIQT() { this.initialize(); }
 
   /** 
-   * Trigger pointer cleanup before shutting down
+   * Trigger pointer cleanup before shutting down. The providers stay loaded
+   * until every BIQT instance has been destroyed.
    */
   @PreDestroy
   public void destroy() {
     this.cleanup();
   }
 
-  public native List<ProviderInfo> getProviders();
+  /**
+   * Gets the available providers. The list is read from native code once and
+   * cached.
+   *
+   * @return An unmodifiable list of the available providers.
+   */
+  public List<ProviderInfo> getProviders() {
+    List<ProviderInfo> list = this.providers;
+    if (list == null) {
+      list = Collections.unmodifiableList(loadProviders());
+      this.providers = list;
+    }
+    return list;
+  }
+
+  /**
+   * Reads the list of available providers from native code.
+   */
+  private native List<ProviderInfo> loadProviders();
 
   /**
    * Initializes the necessary variables in native code
@@ -72,21 +112,28 @@ public class BIQT {
   public native void initialize();
 
   /**
-   * Runs one or more providers based on modality
+   * Runs one or more providers based on modality. The files are evaluated in
+   * parallel in native code.
    *
    * @param modality The modality of the provider to run, e.g. "iris"
    * @param inputFiles The files to analyze for quality with the specified
    *	providers.
    *
-   *	@return A list of JSONObjects containing the provider results.
+   *	@return A list of JSONObjects, one per input file. When a single
+   *	provider has the modality, each object is that provider's result.
+   *	Otherwise each maps provider names to provider results; see
+   *	{@link #evaluateModality(String, List)} for typed results.
    */
   public List<JSONObject> runModality(String modality,
                                       List<String> inputFiles) {
     String result;
     JSONParser parser = new JSONParser();
     List<JSONObject> results = new ArrayList<>();
-    for (String inputFile : inputFiles) {
-      result = runModality(modality, inputFile);
+    String[] files = inputFiles.toArray(new String[0]);
+    String[] batch = runModalityBatch(modality, files);
+    for (int i = 0; i < files.length; i++) {
+      String inputFile = files[i];
+      result = batch[i];
       try {
         JSONObject json = (JSONObject)parser.parse(result);
         results.add(json);
@@ -114,7 +161,8 @@ public class BIQT {
   }
 
   /**
-   * Runs a provider with the specified name
+   * Runs a provider with the specified name. The files are evaluated in
+   * parallel in native code.
    *
    * @param provider The name of the provider to run.
    * @param inputFiles The files to analyze for quality with the specified
@@ -127,9 +175,12 @@ public class BIQT {
     String result;
     JSONParser parser = new JSONParser();
     List<JSONObject> results = new ArrayList<>();
+    String[] files = inputFiles.toArray(new String[0]);
+    String[] batch = runProviderBatch(provider, files);
 
-    for (String inputFile : inputFiles) {
-      result = runProvider(provider, inputFile);
+    for (int i = 0; i < files.length; i++) {
+      String inputFile = files[i];
+      result = batch[i];
       try {
         JSONObject json = (JSONObject)parser.parse(result);
         results.add(json);
@@ -141,6 +192,190 @@ public class BIQT {
     return results;
   }
 
+  /**
+   * Runs a provider with the specified name and returns typed results. Unlike
+   * runProvider(), the results are built in native code without a JSON round
+   * trip.
+   *
+   * @param provider The name of the provider to run.
+   * @param inputFiles The files to analyze for quality with the specified
+   *	provider.
+   *
+   *	@return The results, in the order of inputFiles.
+   */
+  public List<EvaluationResult> evaluateProvider(String provider,
+                                                 List<String> inputFiles) {
+    return Arrays.asList(
+        evaluateProviderBatch(provider, inputFiles.toArray(new String[0])));
+  }
+
+  /**
+   * Runs the specified provider and returns typed results.
+   *
+   * @param provider The ProviderInfo related to the provider to run.
+   * @param inputFiles The files to analyze for quality with the specified
+   *	provider.
+   *
+   *	@return The results, in the order of inputFiles.
+   */
+  public List<EvaluationResult> evaluateProvider(ProviderInfo provider,
+                                                 List<String> inputFiles) {
+    return this.evaluateProvider(provider.getName(), inputFiles);
+  }
+
+  /**
+   * Runs one or more providers based on modality and returns typed results.
+   *
+   * @param modality The modality of the providers to run, e.g. "iris"
+   * @param inputFiles The files to analyze for quality with the specified
+   *	providers.
+   *
+   *	@return For each input file, in order, a map from provider name to the
+   *	result of that provider.
+   */
+  public List<Map<String, EvaluationResult>> evaluateModality(
+      String modality, List<String> inputFiles) {
+    return Arrays.asList(
+        evaluateModalityBatch(modality, inputFiles.toArray(new String[0])));
+  }
+
+  /**
+   * Runs a provider with the specified name on an image in memory, without
+   * writing it to a file. The bytes between the buffer's position and limit
+   * are evaluated; the position is not changed. The contents of a direct
+   * buffer are passed to providers without a copy.
+   *
+   * <p>A provider which exceeds its time limit keeps reading the image after
+   * this method returns, until the provider itself returns. The buffer is
+   * kept reachable until then, but its contents must not be modified.
+   *
+   * @param provider The name of the provider to run.
+   * @param image The encoded image.
+   *
+   * @return The result of the provider.
+   */
+  public EvaluationResult evaluateProvider(String provider, ByteBuffer image) {
+    return (EvaluationResult)this.evaluateBuffer(false, provider, image);
+  }
+
+  /**
+   * Runs a provider with the specified name on an image in memory, without
+   * writing it to a file. As with {@link #evaluateProvider(String, ByteBuffer)},
+   * the array must not be modified while a provider which exceeded its time
+   * limit may still be reading it. Depending on the JVM the array may be
+   * copied once.
+   *
+   * @param provider The name of the provider to run.
+   * @param image The encoded image.
+   *
+   * @return The result of the provider.
+   */
+  public EvaluationResult evaluateProvider(String provider, byte[] image) {
+    return (EvaluationResult)evaluateBytes(false, provider, image, 0,
+                                           image.length);
+  }
+
+  /**
+   * Runs one or more providers based on modality on an image in memory. The
+   * bytes between the buffer's position and limit are evaluated; the
+   * position is not changed. The contents must not be modified while a
+   * provider which exceeded its time limit may still be reading them.
+   *
+   * @param modality The modality of the providers to run, e.g. "iris"
+   * @param image The encoded image.
+   *
+   * @return A map from provider name to the result of that provider.
+   */
+  @SuppressWarnings("unchecked")
+  public Map<String, EvaluationResult> evaluateModality(String modality,
+                                                        ByteBuffer image) {
+    return (Map<String, EvaluationResult>)this.evaluateBuffer(true, modality,
+                                                              image);
+  }
+
+  /**
+   * Runs one or more providers based on modality on an image in memory.
+   * The array must not be modified while a provider which exceeded its time
+   * limit may still be reading it.
+   *
+   * @param modality The modality of the providers to run, e.g. "iris"
+   * @param image The encoded image.
+   *
+   * @return A map from provider name to the result of that provider.
+   */
+  @SuppressWarnings("unchecked")
+  public Map<String, EvaluationResult> evaluateModality(String modality,
+                                                        byte[] image) {
+    return (Map<String, EvaluationResult>)evaluateBytes(true, modality, image,
+                                                        0, image.length);
+  }
+
+  private Object evaluateBuffer(boolean modality, String name,
+                                ByteBuffer image) {
+    if (image.isDirect()) {
+      return evaluateDirect(modality, name, image, image.position(),
+                            image.remaining());
+    }
+    if (image.hasArray()) {
+      return evaluateBytes(modality, name, image.array(),
+                           image.arrayOffset() + image.position(),
+                           image.remaining());
+    }
+    // A read-only heap buffer does not expose its array.
+    byte[] bytes = new byte[image.remaining()];
+    image.duplicate().get(bytes);
+    return evaluateBytes(modality, name, bytes, 0, bytes.length);
+  }
+
+  /**
+   * Runs a provider with the specified name without blocking.
+   *
+   * @param provider The name of the provider to run.
+   * @param inputFile The file to analyze for quality.
+   *
+   * @return A future which is completed with the result on a native worker
+   *	thread.
+   */
+  public CompletableFuture<EvaluationResult> runProviderAsync(String provider,
+                                                              String inputFile) {
+    CompletableFuture<EvaluationResult> future = new CompletableFuture<>();
+    submitProvider(provider, inputFile, future);
+    return future;
+  }
+
+  /**
+   * Runs the specified provider without blocking.
+   *
+   * @param provider The ProviderInfo related to the provider to run.
+   * @param inputFile The file to analyze for quality.
+   *
+   * @return A future which is completed with the result on a native worker
+   *	thread.
+   */
+  public CompletableFuture<EvaluationResult> runProviderAsync(ProviderInfo provider,
+                                                              String inputFile) {
+    return this.runProviderAsync(provider.getName(), inputFile);
+  }
+
+  /**
+   * Runs one or more providers based on modality without blocking.
+   *
+   * @param modality The modality of the providers to run, e.g. "iris"
+   * @param inputFile The file to analyze for quality.
+   *
+   * @return A future which is completed on a native worker thread with a map
+   *	from provider name to the result of that provider. The map is empty if
+   *	no provider has the modality. The future completes exceptionally with a
+   *	RuntimeException if the providers could not be run.
+   */
+  public CompletableFuture<Map<String, EvaluationResult>> runModalityAsync(
+      String modality, String inputFile) {
+    CompletableFuture<Map<String, EvaluationResult>> future =
+        new CompletableFuture<>();
+    submitModality(modality, inputFile, future);
+    return future;
+  }
+
   /**
    * Calls the specified provider in native code.
    *
@@ -157,6 +392,91 @@ public class BIQT {
    */
   private native String runModality(String modality, String inputfile);
 
+  /**
+   * Calls the specified provider on several files in native code.
+   *
+   * @param provider The name of the provider to be run.
+   * @param inputFiles The files to analyze with the given provider.
+   *
+   * @return The serialized results, in the order of inputFiles.
+   */
+  private native String[] runProviderBatch(String provider, String[] inputFiles);
+
+  /**
+   * Calls the providers with the specified modality on several files in
+   * native code.
+   *
+   * @param modality The modality of the providers to be run.
+   * @param inputFiles The files to analyze with the given providers.
+   *
+   * @return The serialized results, in the order of inputFiles.
+   */
+  private native String[] runModalityBatch(String modality, String[] inputFiles);
+
+  /**
+   * Calls the specified provider on several files in native code.
+   *
+   * @param provider The name of the provider to be run.
+   * @param inputFiles The files to analyze with the given provider.
+   *
+   * @return The results, in the order of inputFiles.
+   */
+  private native EvaluationResult[] evaluateProviderBatch(String provider,
+                                                          String[] inputFiles);
+
+  /**
+   * Calls the providers with the specified modality on several files in
+   * native code.
+   *
+   * @param modality The modality of the providers to be run.
+   * @param inputFiles The files to analyze with the given providers.
+   *
+   * @return For each input file, a map from provider name to result.
+   */
+  private native Map<String, EvaluationResult>[] evaluateModalityBatch(
+      String modality, String[] inputFiles);
+
+  /**
+   * Calls a provider, or the providers of a modality, on the contents of a
+   * direct ByteBuffer in native code.
+   *
+   * @return An EvaluationResult, or a Map from provider name to result.
+   */
+  private native Object evaluateDirect(boolean modality, String name,
+                                       ByteBuffer buffer, int offset,
+                                       int length);
+
+  /**
+   * Calls a provider, or the providers of a modality, on the contents of a
+   * byte array in native code.
+   *
+   * @return An EvaluationResult, or a Map from provider name to result.
+   */
+  private native Object evaluateBytes(boolean modality, String name,
+                                      byte[] bytes, int offset, int length);
+
+  /**
+   * Queues the specified provider on the native worker pool.
+   *
+   * @param provider The name of the provider to be run.
+   * @param inputFile The file to analyze with the given provider.
+   * @param future Completed with the result.
+   */
+  private native void submitProvider(String provider, String inputFile,
+                                     CompletableFuture<EvaluationResult> future);
+
+  /**
+   * Queues the providers with the specified modality on the native worker
+   * pool.
+   *
+   * @param modality The modality of the providers to be run.
+   * @param inputFile The file to analyze with the given providers.
+   * @param future Completed with a map from provider name to result.
+   */
+  private native void submitModality(
+      String modality, String inputFile,
+      CompletableFuture<Map<String, EvaluationResult>> future);
+
   /**
    * Cleans up and frees any memory allocated in native code.
    */
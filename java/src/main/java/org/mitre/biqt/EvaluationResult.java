@@ -0,0 +1,87 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+package org.mitre.biqt;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+
+/**
+ * The result of running a provider on one input file.
+ */
+public final class EvaluationResult {
+
+  private final String provider;
+  private final int errorCode;
+  private final String message;
+  private final List<QualityResult> qualityResults;
+
+  /**
+   * Creates a new result. Intended to be called from native code, and should
+   * not be instantiated from Java.
+   *
+   * The first {@code metricCount} keys name quality metrics and the remaining
+   * keys name features. The value of key {@code k} for detection {@code d} is
+   * {@code values[d * keys.length + k]}, and {@code present} at the same index
+   * tells whether the detection reports that key.
+   *
+   * @param provider The name of the provider
+   * @param errorCode Zero on success, non-zero on error
+   * @param message A message for the application
+   * @param keys The metric keys followed by the feature keys
+   * @param metricCount The number of metric keys at the start of keys
+   * @param detections The number of detections
+   * @param values The values of each detection, one row per detection
+   * @param present Whether each value was reported
+   */
+  private EvaluationResult(String provider, int errorCode, String message,
+                           String[] keys, int metricCount, int detections,
+                           double[] values, boolean[] present) {
+    this.provider = provider;
+    this.errorCode = errorCode;
+    this.message = message;
+    List<QualityResult> detected = new ArrayList<>(detections);
+    for (int d = 0; d < detections; d++) {
+      detected.add(
+          new QualityResult(keys, metricCount, values, present,
+                            d * keys.length));
+    }
+    this.qualityResults = Collections.unmodifiableList(detected);
+  }
+
+  /**
+   * Gets the name of the provider which produced this result
+   *
+   * @return The provider name as a String
+   */
+  public String getProvider() { return this.provider; }
+
+  /**
+   * Gets the error code returned by the provider
+   *
+   * @return Zero on success, non-zero on error
+   */
+  public int getErrorCode() { return this.errorCode; }
+
+  /**
+   * Gets the message returned by the provider
+   *
+   * @return The message as a String
+   */
+  public String getMessage() { return this.message; }
+
+  /**
+   * Gets the detections found in the input file
+   *
+   * @return An unmodifiable list with one entry per detection
+   */
+  public List<QualityResult> getQualityResults() { return this.qualityResults; }
+}
@@ -54,6 +54,20 @@ public abstract class Provider {
 	protected abstract void setResults(String filename, JSONObject features,
 									   JSONObject metrics);
 
+	/**
+	 * Evaluates an image file and returns the result in a form which BIQT can
+	 * read without parsing JSON. Providers which report many detections or
+	 * metrics should override this method. When it returns null, BIQT calls
+	 * evaluate() instead for that file.
+	 *
+	 * @param filename The path to the file to be evaluated.
+	 *
+	 * @return The result, or null to use evaluate().
+	 */
+	public StructuredResult evaluateStructured(String filename) {
+		return null;
+	}
+
 	public static List<Class> getProviders() {
 		return null;
 	}
@@ -0,0 +1,97 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+package org.mitre.biqt;
+
+import java.util.Collections;
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+/**
+ * The metrics and features of one detection in an {@link EvaluationResult}.
+ *
+ * Detections of a result share its key table and value array, so a
+ * QualityResult holds only its offset into them.
+ */
+public final class QualityResult {
+
+  private final String[] keys;
+  private final int metricCount;
+  private final double[] values;
+  private final boolean[] present;
+  private final int offset;
+
+  QualityResult(String[] keys, int metricCount, double[] values,
+                boolean[] present, int offset) {
+    this.keys = keys;
+    this.metricCount = metricCount;
+    this.values = values;
+    this.present = present;
+    this.offset = offset;
+  }
+
+  /**
+   * Gets a quality metric.
+   *
+   * @param name The name of the metric
+   * @return The value, or null if this detection does not report it
+   */
+  public Double getMetric(String name) {
+    return this.find(name, 0, this.metricCount);
+  }
+
+  /**
+   * Gets a feature.
+   *
+   * @param name The name of the feature
+   * @return The value, or null if this detection does not report it
+   */
+  public Double getFeature(String name) {
+    return this.find(name, this.metricCount, this.keys.length);
+  }
+
+  /**
+   * Gets all quality metrics reported by this detection.
+   *
+   * @return An unmodifiable map from metric name to value
+   */
+  public Map<String, Double> getMetrics() {
+    return this.collect(0, this.metricCount);
+  }
+
+  /**
+   * Gets all features reported by this detection.
+   *
+   * @return An unmodifiable map from feature name to value
+   */
+  public Map<String, Double> getFeatures() {
+    return this.collect(this.metricCount, this.keys.length);
+  }
+
+  private Double find(String name, int begin, int end) {
+    for (int k = begin; k < end; k++) {
+      if (this.keys[k].equals(name)) {
+        return this.present[this.offset + k] ? this.values[this.offset + k]
+                                              : null;
+      }
+    }
+    return null;
+  }
+
+  private Map<String, Double> collect(int begin, int end) {
+    Map<String, Double> map = new LinkedHashMap<>();
+    for (int k = begin; k < end; k++) {
+      if (this.present[this.offset + k]) {
+        map.put(this.keys[k], this.values[this.offset + k]);
+      }
+    }
+    return Collections.unmodifiableMap(map);
+  }
+}
@@ -0,0 +1,105 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+package org.mitre.biqt;
+
+/**
+ * A provider result in a compact form which BIQT reads directly from native
+ * code, without converting it to and from JSON.
+ *
+ * All detections share one table of keys. The first {@code metricCount} keys
+ * name quality metrics and the remaining keys name features. The value of key
+ * {@code k} for detection {@code d} is {@code values[d * keys.length + k]};
+ * {@code Double.NaN} marks a key which a detection does not report.
+ */
+public final class StructuredResult {
+
+  private final String provider;
+  private final int errorCode;
+  private final String message;
+  private final String[] keys;
+  private final int metricCount;
+  private final int detections;
+  private final double[] values;
+
+  /**
+   * Creates a new result.
+   *
+   * @param provider The name of the provider
+   * @param errorCode Zero on success, non-zero on error
+   * @param message A message for the application, or null
+   * @param keys The metric keys followed by the feature keys
+   * @param metricCount The number of metric keys at the start of keys
+   * @param detections The number of detections
+   * @param values The values of each detection, one row per detection
+   */
+  public StructuredResult(String provider, int errorCode, String message,
+                          String[] keys, int metricCount, int detections,
+                          double[] values) {
+    if (metricCount < 0 || metricCount > keys.length) {
+      throw new IllegalArgumentException("metricCount is out of range");
+    }
+    if (detections < 0 || values.length != detections * keys.length) {
+      throw new IllegalArgumentException(
+          "values must hold one value per key for each detection");
+    }
+    this.provider = provider;
+    this.errorCode = errorCode;
+    this.message = message;
+    this.keys = keys;
+    this.metricCount = metricCount;
+    this.detections = detections;
+    this.values = values;
+  }
+
+  /**
+   * Creates a result which reports an error and no detections.
+   *
+   * @param provider The name of the provider
+   * @param errorCode The non-zero error code
+   * @param message A description of the error
+   */
+  public static StructuredResult error(String provider, int errorCode,
+                                       String message) {
+    return new StructuredResult(provider, errorCode, message, new String[0],
+                                0, 0, new double[0]);
+  }
+
+  public String getProvider() { return this.provider; }
+
+  public int getErrorCode() { return this.errorCode; }
+
+  public String getMessage() { return this.message; }
+
+  public int getDetectionCount() { return this.detections; }
+
+  public int getMetricCount() { return this.metricCount; }
+
+  /**
+   * Gets a value.
+   *
+   * @param detection The index of the detection
+   * @param key The index of the key
+   * @return The value, or NaN if the detection does not report the key
+   */
+  public double getValue(int detection, int key) {
+    return this.values[detection * this.keys.length + key];
+  }
+
+  /**
+   * Gets the name of a key.
+   *
+   * @param key The index of the key
+   * @return The name of the key
+   */
+  public String getKey(int key) { return this.keys[key]; }
+
+  public int getKeyCount() { return this.keys.length; }
+}
@@ -4,7 +4,11 @@ import org.json.simple.JSONObject;
 import org.junit.Test;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertTrue;
+import java.nio.ByteBuffer;
+import java.nio.file.Files;
+import java.nio.file.Paths;
 import java.util.List;
+import java.util.Map;
 import java.util.ArrayList;
 
 public class TestBIQT {
@@ -40,5 +44,57 @@ public class TestBIQT {
     inputFiles.add(System.getenv("BIQT_HOME") + "/../images/iris1.bmp");
     List<JSONObject> results = app.runModality("iris", inputFiles);
     assertTrue("Received an empty result set", results.size() > 0);
+    assertTrue("Expected the result of the only iris provider",
+               results.get(0).containsKey("errorCode"));
+  }
+
+  @Test
+  public void testEvaluateProvider() {
+    BIQT app = new BIQT();
+    ArrayList<String> inputFiles = new ArrayList<>();
+    inputFiles.add(System.getenv("BIQT_HOME") + "/../images/iris1.bmp");
+    List<EvaluationResult> results = app.evaluateProvider("BIQTIris", inputFiles);
+    assertEquals(1, results.size());
+    assertEquals(0, results.get(0).getErrorCode());
+  }
+
+  @Test
+  public void testEvaluateModality() {
+    BIQT app = new BIQT();
+    ArrayList<String> inputFiles = new ArrayList<>();
+    inputFiles.add(System.getenv("BIQT_HOME") + "/../images/iris1.bmp");
+    List<Map<String, EvaluationResult>> results =
+        app.evaluateModality("iris", inputFiles);
+    assertEquals(1, results.size());
+    assertTrue("Received no providers", results.get(0).containsKey("BIQTIris"));
+  }
+
+  @Test
+  public void testRunProviderAsync() throws Exception {
+    BIQT app = new BIQT();
+    EvaluationResult result = app.runProviderAsync(
+        "BIQTIris", System.getenv("BIQT_HOME") + "/../images/iris1.bmp").get();
+    assertEquals(0, result.getErrorCode());
+  }
+
+  @Test
+  public void testRunModalityAsync() throws Exception {
+    BIQT app = new BIQT();
+    Map<String, EvaluationResult> results = app.runModalityAsync(
+        "iris", System.getenv("BIQT_HOME") + "/../images/iris1.bmp").get();
+    assertTrue("Received no providers", results.containsKey("BIQTIris"));
+  }
+
+  @Test
+  public void testEvaluateProviderBuffer() throws Exception {
+    BIQT app = new BIQT();
+    byte[] image = Files.readAllBytes(
+        Paths.get(System.getenv("BIQT_HOME") + "/../images/iris1.bmp"));
+    ByteBuffer direct = ByteBuffer.allocateDirect(image.length);
+    direct.put(image).flip();
+    assertEquals(0, app.evaluateProvider("BIQTIris", direct).getErrorCode());
+    assertEquals(0, app.evaluateProvider("BIQTIris", image).getErrorCode());
+    assertTrue("Received no providers",
+               app.evaluateModality("iris", image).containsKey("BIQTIris"));
   }
 }
@@ -0,0 +1,625 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+// Python bindings for the BIQT library. Inputs are either paths or objects
+// supporting the buffer protocol (bytes, bytearray, memoryview, NumPy arrays
+// and so on); buffers are passed to providers in place, without a copy. The
+// GIL is released while providers run, so Python threads which share one
+// BIQT object evaluate concurrently.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BIQT.h"
+
+namespace {
+
+struct BIQTObject {
+    PyObject_HEAD
+    BIQT *app;
+    unsigned int busy; /* Evaluations running without the GIL */
+};
+
+/**
+ * Releases a buffer once no evaluation reads it any longer. An evaluation
+ * which exceeded its time limit may drop the last reference on its own
+ * thread, without the GIL.
+ */
+void release_buffer(Py_buffer *view)
+{
+    if (view->obj && Py_IsInitialized()) {
+        PyGILState_STATE state = PyGILState_Ensure();
+        PyBuffer_Release(view);
+        PyGILState_Release(state);
+    }
+    delete view;
+}
+
+/**
+ * An input received from Python. A buffer is held, which keeps its exporter
+ * from resizing or freeing it, until the object and every evaluation using
+ * it are gone. Objects must be created and destroyed while the GIL is held.
+ */
+class Source {
+  public:
+    Source() = default;
+    Source(const Source &) = delete;
+    Source &operator=(const Source &) = delete;
+
+    /**
+     * Acquires a buffer or reads a path (str or os.PathLike). Since bytes
+     * support the buffer protocol they are always input data, never a path.
+     *
+     * @return false with a Python exception set if obj is neither.
+     */
+    bool load(PyObject *obj)
+    {
+        if (PyObject_CheckBuffer(obj)) {
+            std::shared_ptr<Py_buffer> view(new Py_buffer(), release_buffer);
+            if (PyObject_GetBuffer(obj, view.get(), PyBUF_C_CONTIGUOUS) != 0) {
+                return false;
+            }
+            this->view = std::move(view);
+            return true;
+        }
+        PyObject *encoded = nullptr;
+        if (!PyUnicode_FSConverter(obj, &encoded)) {
+            return false;
+        }
+        this->path = PyBytes_AS_STRING(encoded);
+        Py_DECREF(encoded);
+        return true;
+    }
+
+    bool isBuffer() const { return this->view != nullptr; }
+
+    /**
+     * Wraps the input for evaluation. May be called without the GIL.
+     */
+    MappedInput *input() const
+    {
+        if (this->isBuffer()) {
+            return new MappedInput(
+                static_cast<const unsigned char *>(this->view->buf),
+                static_cast<size_t>(this->view->len), "<memory>", this->view);
+        }
+        return new MappedInput(this->path);
+    }
+
+    std::string path;
+
+  private:
+    std::shared_ptr<Py_buffer> view;
+};
+
+PyObject *to_str(const std::string &str)
+{
+    // Provider messages are not guaranteed to be valid UTF-8.
+    return PyUnicode_DecodeUTF8(str.data(), static_cast<Py_ssize_t>(str.size()),
+                                "replace");
+}
+
+PyObject *to_dict(const std::map<std::string, double> &values)
+{
+    PyObject *dict = PyDict_New();
+    if (!dict) {
+        return nullptr;
+    }
+    for (const auto &value : values) {
+        PyObject *key = to_str(value.first);
+        PyObject *number = PyFloat_FromDouble(value.second);
+        if (!key || !number || PyDict_SetItem(dict, key, number) < 0) {
+            Py_XDECREF(key);
+            Py_XDECREF(number);
+            Py_DECREF(dict);
+            return nullptr;
+        }
+        Py_DECREF(key);
+        Py_DECREF(number);
+    }
+    return dict;
+}
+
+/**
+ * Converts a result to a dict with the same layout as the JSON a provider
+ * returns: provider, errorCode, message and a qualityResult list of
+ * {"metrics": {...}, "features": {...}} dicts.
+ */
+PyObject *to_dict(const Provider::EvaluationResult &result)
+{
+    PyObject *qualityResults =
+        PyList_New(static_cast<Py_ssize_t>(result.qualityResult.size()));
+    if (!qualityResults) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < result.qualityResult.size(); i++) {
+        const Provider::QualityResult &quality = result.qualityResult[i];
+        PyObject *item = Py_BuildValue(
+            "{s:N,s:N}", "metrics", to_dict(quality.metrics), "features",
+            to_dict(quality.features));
+        if (!item) {
+            Py_DECREF(qualityResults);
+            return nullptr;
+        }
+        PyList_SET_ITEM(qualityResults, static_cast<Py_ssize_t>(i), item);
+    }
+    return Py_BuildValue("{s:N,s:i,s:N,s:N}", "provider",
+                         to_str(result.provider), "errorCode",
+                         result.errorCode, "message", to_str(result.message),
+                         "qualityResult", qualityResults);
+}
+
+PyObject *to_dict(const std::map<std::string, Provider::EvaluationResult> &results)
+{
+    PyObject *dict = PyDict_New();
+    if (!dict) {
+        return nullptr;
+    }
+    for (const auto &result : results) {
+        PyObject *key = to_str(result.first);
+        PyObject *value = to_dict(result.second);
+        if (!key || !value || PyDict_SetItem(dict, key, value) < 0) {
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            Py_DECREF(dict);
+            return nullptr;
+        }
+        Py_DECREF(key);
+        Py_DECREF(value);
+    }
+    return dict;
+}
+
+template <typename T> PyObject *to_list(const std::vector<T> &results)
+{
+    PyObject *list = PyList_New(static_cast<Py_ssize_t>(results.size()));
+    if (!list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        PyObject *item = to_dict(results[i]);
+        if (!item) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), item);
+    }
+    return list;
+}
+
+BIQT *get_app(BIQTObject *self)
+{
+    if (!self->app) {
+        PyErr_SetString(PyExc_ValueError, "The BIQT object is closed.");
+    }
+    return self->app;
+}
+
+PyObject *biqt_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = {nullptr};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, ":BIQT",
+                                     const_cast<char **>(keywords))) {
+        return nullptr;
+    }
+    BIQTObject *self = reinterpret_cast<BIQTObject *>(type->tp_alloc(type, 0));
+    if (!self) {
+        return nullptr;
+    }
+    std::string error;
+    // Loading providers may start a JVM, which takes a while.
+    PyThreadState *state = PyEval_SaveThread();
+    try {
+        self->app = new BIQT();
+    }
+    catch (const std::exception &e) {
+        error = e.what();
+    }
+    PyEval_RestoreThread(state);
+    if (!error.empty()) {
+        Py_DECREF(self);
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return nullptr;
+    }
+    return reinterpret_cast<PyObject *>(self);
+}
+
+/**
+ * Destroys the native object. Pending pool work completes first, so the GIL
+ * is released in case it evaluates Python providers.
+ */
+void close_app(BIQTObject *self)
+{
+    BIQT *app = self->app;
+    self->app = nullptr;
+    if (app) {
+        PyThreadState *state = PyEval_SaveThread();
+        delete app;
+        PyEval_RestoreThread(state);
+    }
+}
+
+/**
+ * Closes the object unless another thread is evaluating with it.
+ */
+bool try_close(BIQTObject *self)
+{
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "The BIQT object is in use by another thread.");
+        return false;
+    }
+    close_app(self);
+    return true;
+}
+
+void biqt_dealloc(BIQTObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    close_app(self);
+    type->tp_free(reinterpret_cast<PyObject *>(self));
+    Py_DECREF(type);
+}
+
+PyObject *biqt_close(BIQTObject *self, PyObject *)
+{
+    if (!try_close(self)) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *biqt_enter(BIQTObject *self, PyObject *)
+{
+    if (!get_app(self)) {
+        return nullptr;
+    }
+    Py_INCREF(self);
+    return reinterpret_cast<PyObject *>(self);
+}
+
+PyObject *biqt_exit(BIQTObject *self, PyObject *)
+{
+    if (!try_close(self)) {
+        return nullptr;
+    }
+    Py_RETURN_FALSE;
+}
+
+PyObject *biqt_version(BIQTObject *self, PyObject *)
+{
+    BIQT *app = get_app(self);
+    return app ? to_str(app->version()) : nullptr;
+}
+
+PyObject *biqt_providers(BIQTObject *self, PyObject *)
+{
+    BIQT *app = get_app(self);
+    if (!app) {
+        return nullptr;
+    }
+    std::vector<ProviderInfo *> providers = app->getProviders();
+    PyObject *list = PyList_New(static_cast<Py_ssize_t>(providers.size()));
+    if (!list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < providers.size(); i++) {
+        const ProviderInfo *p = providers[i];
+        PyObject *item = Py_BuildValue(
+            "{s:N,s:N,s:N,s:N,s:N,s:O}", "name", to_str(p->name), "version",
+            to_str(p->version), "description", to_str(p->description),
+            "modality", to_str(p->modality), "sourceLanguage",
+            to_str(p->sourceLanguage), "threadSafe",
+            p->threadSafe ? Py_True : Py_False);
+        if (!item) {
+            Py_DECREF(list);
+            return nullptr;
+        }
+        PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), item);
+    }
+    return list;
+}
+
+PyObject *biqt_set_threads(BIQTObject *self, PyObject *args)
+{
+    unsigned int threads;
+    if (!PyArg_ParseTuple(args, "I:set_threads", &threads)) {
+        return nullptr;
+    }
+    BIQT *app = get_app(self);
+    if (!app) {
+        return nullptr;
+    }
+    app->setThreads(threads);
+    Py_RETURN_NONE;
+}
+
+PyObject *biqt_set_timeout(BIQTObject *self, PyObject *args)
+{
+    unsigned int milliseconds;
+    if (!PyArg_ParseTuple(args, "I:set_timeout", &milliseconds)) {
+        return nullptr;
+    }
+    BIQT *app = get_app(self);
+    if (!app) {
+        return nullptr;
+    }
+    app->setTimeout(milliseconds);
+    Py_RETURN_NONE;
+}
+
+/**
+ * Runs a provider, or all providers of a modality, on one input.
+ */
+PyObject *run(BIQTObject *self, PyObject *args, PyObject *kwds, bool modality)
+{
+    static const char *providerKeywords[] = {"provider", "source", "timeout",
+                                             nullptr};
+    static const char *modalityKeywords[] = {"modality", "source", "timeout",
+                                             nullptr};
+    const char *name;
+    PyObject *obj;
+    unsigned int timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, modality ? "sO|I:run_modality" : "sO|I:run_provider",
+            const_cast<char **>(modality ? modalityKeywords
+                                         : providerKeywords),
+            &name, &obj, &timeout)) {
+        return nullptr;
+    }
+    BIQT *app = get_app(self);
+    Source source;
+    if (!app || !source.load(obj)) {
+        return nullptr;
+    }
+
+    std::string nameStr(name);
+    Provider::EvaluationResult result;
+    std::map<std::string, Provider::EvaluationResult> results;
+    std::string error;
+    self->busy++;
+    PyThreadState *state = PyEval_SaveThread();
+    try {
+        std::unique_ptr<MappedInput> input(source.input());
+        if (modality) {
+            results = app->runModality(nameStr, *input, timeout);
+        }
+        else {
+            result = app->runProvider(nameStr, *input, timeout);
+        }
+    }
+    catch (const std::exception &e) {
+        error = e.what();
+    }
+    PyEval_RestoreThread(state);
+    self->busy--;
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return nullptr;
+    }
+    return modality ? to_dict(results) : to_dict(result);
+}
+
+PyObject *biqt_run_provider(BIQTObject *self, PyObject *args, PyObject *kwds)
+{
+    return run(self, args, kwds, false);
+}
+
+PyObject *biqt_run_modality(BIQTObject *self, PyObject *args, PyObject *kwds)
+{
+    return run(self, args, kwds, true);
+}
+
+/**
+ * Runs a provider, or all providers of a modality, on a sequence of inputs on
+ * the BIQT thread pool.
+ *
+ * A batch of paths is evaluated with the path overloads, which map each file
+ * only while it is evaluated. Once any input is a buffer, every input is
+ * wrapped in a MappedInput up front.
+ */
+PyObject *run_batch(BIQTObject *self, PyObject *args, PyObject *kwds,
+                    bool modality)
+{
+    static const char *providerKeywords[] = {"provider", "sources", nullptr};
+    static const char *modalityKeywords[] = {"modality", "sources", nullptr};
+    const char *name;
+    PyObject *obj;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds,
+            modality ? "sO:run_modality_batch" : "sO:run_provider_batch",
+            const_cast<char **>(modality ? modalityKeywords
+                                         : providerKeywords),
+            &name, &obj)) {
+        return nullptr;
+    }
+    BIQT *app = get_app(self);
+    if (!app) {
+        return nullptr;
+    }
+    PyObject *seq = PySequence_Fast(obj, "sources must be iterable");
+    if (!seq) {
+        return nullptr;
+    }
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    std::vector<std::unique_ptr<Source>> sources;
+    sources.reserve(static_cast<size_t>(count));
+    bool buffers = false;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        sources.emplace_back(new Source());
+        if (!sources.back()->load(PySequence_Fast_GET_ITEM(seq, i))) {
+            Py_DECREF(seq);
+            return nullptr;
+        }
+        buffers = buffers || sources.back()->isBuffer();
+    }
+    Py_DECREF(seq);
+
+    std::string nameStr(name);
+    std::vector<Provider::EvaluationResult> results;
+    std::vector<std::map<std::string, Provider::EvaluationResult>>
+        modalityResults;
+    std::string error;
+    self->busy++;
+    PyThreadState *state = PyEval_SaveThread();
+    try {
+        if (buffers) {
+            std::vector<std::unique_ptr<MappedInput>> inputs;
+            std::vector<const MappedInput *> pointers;
+            for (const auto &source : sources) {
+                inputs.emplace_back(source->input());
+                pointers.push_back(inputs.back().get());
+            }
+            if (modality) {
+                modalityResults = app->runModalityBatch(nameStr, pointers);
+            }
+            else {
+                results = app->runProviderBatch(nameStr, pointers);
+            }
+        }
+        else {
+            std::vector<std::string> paths;
+            for (const auto &source : sources) {
+                paths.push_back(source->path);
+            }
+            if (modality) {
+                modalityResults = app->runModalityBatch(nameStr, paths);
+            }
+            else {
+                results = app->runProviderBatch(nameStr, paths);
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        error = e.what();
+    }
+    PyEval_RestoreThread(state);
+    self->busy--;
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return nullptr;
+    }
+    return modality ? to_list(modalityResults) : to_list(results);
+}
+
+PyObject *biqt_run_provider_batch(BIQTObject *self, PyObject *args,
+                                  PyObject *kwds)
+{
+    return run_batch(self, args, kwds, false);
+}
+
+PyObject *biqt_run_modality_batch(BIQTObject *self, PyObject *args,
+                                  PyObject *kwds)
+{
+    return run_batch(self, args, kwds, true);
+}
+
+/**
+ * Casts a method implementation to the type stored in PyMethodDef, by way of
+ * a generic function pointer so that compilers do not warn about it.
+ */
+template <typename F> PyCFunction method(F function)
+{
+    return reinterpret_cast<PyCFunction>(
+        reinterpret_cast<void (*)(void)>(function));
+}
+
+PyMethodDef biqt_methods[] = {
+    {"version", method(biqt_version), METH_NOARGS,
+     "version()\n--\n\nReturns the BIQT version."},
+    {"providers", method(biqt_providers), METH_NOARGS,
+     "providers()\n--\n\nReturns a list of dicts describing the installed "
+     "providers."},
+    {"set_threads", method(biqt_set_threads),
+     METH_VARARGS,
+     "set_threads(threads)\n--\n\nSets the number of threads used by batch "
+     "evaluations. 0 uses one per CPU."},
+    {"set_timeout", method(biqt_set_timeout),
+     METH_VARARGS,
+     "set_timeout(milliseconds)\n--\n\nSets the default time limit for "
+     "each evaluation. 0 disables it."},
+    {"run_provider", method(biqt_run_provider),
+     METH_VARARGS | METH_KEYWORDS,
+     "run_provider(provider, source, timeout=0)\n--\n\nRuns a provider on a "
+     "path or a buffer and returns the result as a dict. A provider which "
+     "exceeds the time limit keeps reading a buffer until it returns, so "
+     "the buffer must not be modified until then."},
+    {"run_modality", method(biqt_run_modality),
+     METH_VARARGS | METH_KEYWORDS,
+     "run_modality(modality, source, timeout=0)\n--\n\nRuns all providers "
+     "of a modality on a path or a buffer and returns a dict of results "
+     "keyed by provider name."},
+    {"run_provider_batch",
+     method(biqt_run_provider_batch),
+     METH_VARARGS | METH_KEYWORDS,
+     "run_provider_batch(provider, sources)\n--\n\nRuns a provider on each "
+     "path or buffer in parallel and returns the results in order."},
+    {"run_modality_batch",
+     method(biqt_run_modality_batch),
+     METH_VARARGS | METH_KEYWORDS,
+     "run_modality_batch(modality, sources)\n--\n\nRuns all providers of a "
+     "modality on each path or buffer in parallel and returns the results "
+     "in order."},
+    {"close", method(biqt_close), METH_NOARGS,
+     "close()\n--\n\nReleases the providers. The object cannot be used "
+     "afterwards."},
+    {"__enter__", method(biqt_enter), METH_NOARGS,
+     nullptr},
+    {"__exit__", method(biqt_exit), METH_VARARGS,
+     nullptr},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyType_Slot biqt_slots[] = {
+    {Py_tp_dealloc, reinterpret_cast<void *>(biqt_dealloc)},
+    {Py_tp_doc,
+     const_cast<char *>("BIQT()\n--\n\nLoads the providers installed in "
+                        "$BIQT_HOME. One object may be shared by several "
+                        "threads.")},
+    {Py_tp_methods, biqt_methods},
+    {Py_tp_new, reinterpret_cast<void *>(biqt_new)},
+    {0, nullptr}};
+
+PyType_Spec biqt_spec = {"biqt.BIQT", sizeof(BIQTObject), 0,
+                         Py_TPFLAGS_DEFAULT, biqt_slots};
+
+PyModuleDef biqt_module = {PyModuleDef_HEAD_INIT,
+                           "biqt",
+                           "Biometric Image Quality Toolkit",
+                           -1,
+                           nullptr,
+                           nullptr,
+                           nullptr,
+                           nullptr,
+                           nullptr};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_biqt(void)
+{
+    PyObject *module = PyModule_Create(&biqt_module);
+    if (!module) {
+        return nullptr;
+    }
+    PyObject *type = PyType_FromSpec(&biqt_spec);
+    if (!type || PyModule_AddObject(module, "BIQT", type) < 0) {
+        Py_XDECREF(type);
+        Py_DECREF(module);
+        return nullptr;
+    }
+    if (PyModule_AddStringConstant(module, "__version__", BIQT_VERSION) < 0) {
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
@@ -0,0 +1,256 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+// Python.h must be included before any standard header.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "python_provider.h"
+
+namespace {
+
+std::once_flag interpreterStarted;
+
+/* The evaluate() function of each registered provider. Only accessed while
+ * the GIL is held. */
+std::map<std::string, PyObject *> evaluators;
+
+/**
+ * Starts the interpreter unless this process already runs one, as it does
+ * when BIQT is used from the biqt Python module. The GIL is then released so
+ * that evaluations on any thread can take it.
+ *
+ * The interpreter is never finalized: extension modules such as NumPy do not
+ * support being initialized twice in one process.
+ */
+void start_interpreter()
+{
+    std::call_once(interpreterStarted, [] {
+        if (!Py_IsInitialized()) {
+            // Leave signal handling to the application.
+            Py_InitializeEx(0);
+            PyEval_SaveThread();
+        }
+    });
+}
+
+/**
+ * Holds the GIL for the lifetime of the object.
+ */
+class GIL {
+  public:
+    GIL() : state(PyGILState_Ensure()) {}
+    ~GIL() { PyGILState_Release(this->state); }
+
+    GIL(const GIL &) = delete;
+    GIL &operator=(const GIL &) = delete;
+
+  private:
+    PyGILState_STATE state;
+};
+
+/**
+ * Describes and clears the pending Python exception.
+ */
+std::string take_error()
+{
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+    std::string message =
+        type ? reinterpret_cast<PyTypeObject *>(type)->tp_name : "Error";
+    PyObject *text = value ? PyObject_Str(value) : nullptr;
+    const char *utf8 = text ? PyUnicode_AsUTF8(text) : nullptr;
+    if (utf8 && *utf8) {
+        message += ": ";
+        message += utf8;
+    }
+    Py_XDECREF(text);
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(traceback);
+    PyErr_Clear();
+    return message;
+}
+
+/**
+ * Copies a dict of names to numbers, such as the metrics of a detection.
+ *
+ * @return false with a Python exception set on failure.
+ */
+bool read_values(PyObject *dict, std::map<std::string, double> &values)
+{
+    if (!dict) {
+        return true;
+    }
+    if (!PyDict_Check(dict)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "metrics and features must be dicts");
+        return false;
+    }
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(dict, &pos, &key, &value)) {
+        const char *name = PyUnicode_AsUTF8(key);
+        if (!name) {
+            return false;
+        }
+        double number = PyFloat_AsDouble(value);
+        if (number == -1.0 && PyErr_Occurred()) {
+            return false;
+        }
+        values[name] = number;
+    }
+    return true;
+}
+
+/**
+ * Reads the value returned by a provider's evaluate().
+ *
+ * @return false with a Python exception set on failure.
+ */
+bool read_result(PyObject *value, Provider::EvaluationResult &result)
+{
+    if (PyUnicode_Check(value)) {
+        const char *json = PyUnicode_AsUTF8(value);
+        if (!json) {
+            return false;
+        }
+        result = Provider::deserializeResult(json);
+        return true;
+    }
+    if (!PyDict_Check(value)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "evaluate() must return a dict or a JSON string");
+        return false;
+    }
+
+    PyObject *errorCode = PyDict_GetItemString(value, "errorCode");
+    if (errorCode) {
+        result.errorCode = static_cast<int>(PyLong_AsLong(errorCode));
+        if (result.errorCode == -1 && PyErr_Occurred()) {
+            return false;
+        }
+    }
+    PyObject *message = PyDict_GetItemString(value, "message");
+    if (message && message != Py_None) {
+        const char *utf8 = PyUnicode_AsUTF8(message);
+        if (!utf8) {
+            return false;
+        }
+        result.message = utf8;
+    }
+    PyObject *qualityResults = PyDict_GetItemString(value, "qualityResult");
+    if (!qualityResults) {
+        return true;
+    }
+    PyObject *seq =
+        PySequence_Fast(qualityResults, "qualityResult must be a list");
+    if (!seq) {
+        return false;
+    }
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        Provider::QualityResult quality;
+        if (!PyDict_Check(item)) {
+            PyErr_SetString(PyExc_TypeError,
+                            "qualityResult must contain dicts");
+            Py_DECREF(seq);
+            return false;
+        }
+        if (!read_values(PyDict_GetItemString(item, "metrics"),
+                         quality.metrics) ||
+            !read_values(PyDict_GetItemString(item, "features"),
+                         quality.features)) {
+            Py_DECREF(seq);
+            return false;
+        }
+        result.qualityResult.push_back(std::move(quality));
+    }
+    Py_DECREF(seq);
+    return true;
+}
+
+} // namespace
+
+void python_provider_register(const char *providerName,
+                              const char *providerPath,
+                              const char *moduleName)
+{
+    start_interpreter();
+    GIL gil;
+
+    PyObject *path = PySys_GetObject("path");
+    PyObject *dir = PyUnicode_DecodeFSDefault(providerPath);
+    if (path && dir && PySequence_Contains(path, dir) == 0) {
+        PyList_Insert(path, 0, dir);
+    }
+    Py_XDECREF(dir);
+    PyErr_Clear();
+
+    PyObject *module = PyImport_ImportModule(moduleName);
+    if (!module) {
+        throw std::runtime_error(
+            "Provider Read error: Unable to import Python module " +
+            std::string(moduleName) + ": " + take_error());
+    }
+    PyObject *evaluate = PyObject_GetAttrString(module, "evaluate");
+    Py_DECREF(module);
+    if (!evaluate || !PyCallable_Check(evaluate)) {
+        Py_XDECREF(evaluate);
+        PyErr_Clear();
+        throw std::runtime_error("Provider API Error: Python module " +
+                                 std::string(moduleName) +
+                                 " does not define evaluate(path)");
+    }
+    PyObject *&slot = evaluators[providerName];
+    Py_XDECREF(slot);
+    slot = evaluate;
+}
+
+int python_provider_evaluate(const char *filePath, const char *providerName,
+                             Provider::EvaluationResult &result)
+{
+    GIL gil;
+    auto evaluator = evaluators.find(providerName);
+    if (evaluator == evaluators.end()) {
+        result.errorCode = Provider::GENERIC_ERROR;
+        result.message = "Python provider is not registered.";
+        return Provider::GENERIC_ERROR;
+    }
+    // Keep the function alive should the provider be registered again by
+    // another BIQT object during the call.
+    PyObject *evaluate = evaluator->second;
+    Py_INCREF(evaluate);
+
+    PyObject *path = PyUnicode_DecodeFSDefault(filePath);
+    PyObject *value =
+        path ? PyObject_CallFunctionObjArgs(evaluate, path, nullptr) : nullptr;
+    Py_XDECREF(path);
+    Py_DECREF(evaluate);
+    if (value && read_result(value, result)) {
+        Py_DECREF(value);
+        return 0;
+    }
+    Py_XDECREF(value);
+    result = Provider::EvaluationResult();
+    result.errorCode = Provider::GENERIC_ERROR;
+    result.message = take_error();
+    std::cerr << "Python provider " << providerName
+              << " failed: " << result.message << std::endl;
+    return Provider::GENERIC_ERROR;
+}
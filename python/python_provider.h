@@ -0,0 +1,47 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef BIQT_PYTHON_PROVIDER_H
+#define BIQT_PYTHON_PROVIDER_H
+
+#include "ProviderInterface.h"
+
+/**
+ * Imports the module of a Python provider into the interpreter shared by all
+ * Python providers in this process, starting the interpreter first if
+ * necessary. The module stays loaded, so models it loads at import time are
+ * reused by every evaluation.
+ *
+ * @param providerName The name of the provider.
+ * @param providerPath The provider directory, which is added to sys.path.
+ * @param moduleName The module which defines evaluate(path).
+ *
+ * @throws std::runtime_error if the module cannot be imported or does not
+ * define evaluate().
+ */
+void python_provider_register(const char *providerName,
+                              const char *providerPath,
+                              const char *moduleName);
+
+/**
+ * Evaluates a file with a Python provider. The provider's evaluate() may
+ * return a dict with the layout of the result JSON, or the JSON itself.
+ *
+ * @param filePath The path to the input file.
+ * @param providerName The name of a registered provider.
+ * @param result Receives the result. On failure, its errorCode is
+ * Provider::GENERIC_ERROR and its message describes the Python exception.
+ *
+ * @return 0 on success, Provider::GENERIC_ERROR on failure.
+ */
+int python_provider_evaluate(const char *filePath, const char *providerName,
+                             Provider::EvaluationResult &result);
+
+#endif // BIQT_PYTHON_PROVIDER_H
@@ -0,0 +1,168 @@
+# #######################################################################
+# NOTICE
+#
+# This software (or technical data) was produced for the U.S. Government
+# under contract, and is subject to the Rights in Data-General Clause
+# 52.227-14, Alt. IV (DEC 2007).
+#
+# Copyright 2019 The MITRE Corporation. All Rights Reserved.
+# #######################################################################
+
+"""Smoke tests for the biqt module and for providers written in Python.
+
+The tests install a Python provider in a temporary BIQT_HOME. Without
+WITH_PYTHON_PROVIDERS the provider is not loaded and only the tests which do
+not need it run.
+"""
+
+import os
+import pathlib
+import shutil
+import tempfile
+import unittest
+
+PROVIDER = "PySmoke"
+MODALITY = "smoke"
+
+DESCRIPTOR = """{
+  "name": "PySmoke",
+  "version": "1.0",
+  "description": "Reports the size of its input.",
+  "sourceLanguage": "python",
+  "module": "pysmoke",
+  "modality": "smoke",
+  "threadSafe": true
+}
+"""
+
+MODULE = """import os
+
+def evaluate(path):
+    if path.endswith(".bad"):
+        raise ValueError("cannot read " + path)
+    return {"errorCode": 0, "message": "",
+            "qualityResult": [{"metrics": {"size": os.path.getsize(path)},
+                               "features": {}}]}
+"""
+
+# Not thread safe, so a batch evaluates one input at a time. The time limit
+# covers one evaluation but not the whole batch.
+SERIAL_DESCRIPTOR = """{
+  "name": "PySerial",
+  "version": "1.0",
+  "description": "Sleeps before reporting the size of its input.",
+  "sourceLanguage": "python",
+  "module": "pyserial",
+  "modality": "serial",
+  "timeout": 1000
+}
+"""
+
+SERIAL_MODULE = """import os
+import time
+
+def evaluate(path):
+    time.sleep(0.2)
+    return {"errorCode": 0, "message": "",
+            "qualityResult": [{"metrics": {"size": os.path.getsize(path)},
+                               "features": {}}]}
+"""
+
+
+def install(home, name, descriptor, module_name, module):
+    provider = os.path.join(home, "providers", name)
+    os.makedirs(provider)
+    with open(os.path.join(provider, "descriptor.json"), "w") as f:
+        f.write(descriptor)
+    with open(os.path.join(provider, module_name + ".py"), "w") as f:
+        f.write(module)
+
+
+def size_of(result):
+    return result["qualityResult"][0]["metrics"]["size"]
+
+
+class TestBIQT(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.home = tempfile.mkdtemp(prefix="biqt-test-")
+        install(cls.home, PROVIDER, DESCRIPTOR, "pysmoke", MODULE)
+        install(cls.home, "PySerial", SERIAL_DESCRIPTOR, "pyserial",
+                SERIAL_MODULE)
+        cls.data = b"\x00\x01biqt\xff" * 100
+        cls.path = os.path.join(cls.home, "input.bin")
+        with open(cls.path, "wb") as f:
+            f.write(cls.data)
+        os.environ["BIQT_HOME"] = cls.home
+
+        import biqt
+        cls.app = biqt.BIQT()
+        names = [p["name"] for p in cls.app.providers()]
+        cls.hasProvider = PROVIDER in names
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.app.close()
+        shutil.rmtree(cls.home)
+
+    def setUp(self):
+        if not self.hasProvider and self._testMethodName != "testErrors":
+            self.skipTest("Python providers are not supported by this build")
+
+    def testPath(self):
+        result = self.app.run_provider(PROVIDER, self.path)
+        self.assertEqual(result["provider"], PROVIDER)
+        self.assertEqual(result["errorCode"], 0)
+        self.assertEqual(size_of(result), len(self.data))
+        result = self.app.run_provider(PROVIDER, pathlib.Path(self.path))
+        self.assertEqual(size_of(result), len(self.data))
+
+    def testBuffer(self):
+        for source in (self.data, bytearray(self.data), memoryview(self.data)):
+            result = self.app.run_provider(PROVIDER, source, timeout=10000)
+            self.assertEqual(result["errorCode"], 0)
+            self.assertEqual(size_of(result), len(self.data))
+
+    def testBytesAreData(self):
+        encoded = os.fsencode(self.path)
+        result = self.app.run_provider(PROVIDER, encoded)
+        self.assertEqual(size_of(result), len(encoded))
+
+    def testModality(self):
+        results = self.app.run_modality(MODALITY, self.data)
+        self.assertEqual(list(results), [PROVIDER])
+        self.assertEqual(size_of(results[PROVIDER]), len(self.data))
+
+    def testBatch(self):
+        self.app.set_threads(4)
+        sources = [self.path, self.data, self.path + ".bad"] * 3
+        results = self.app.run_provider_batch(PROVIDER, sources)
+        self.assertEqual(len(results), len(sources))
+        for source, result in zip(sources, results):
+            if isinstance(source, str) and source.endswith(".bad"):
+                self.assertNotEqual(result["errorCode"], 0)
+                self.assertIn("cannot read", result["message"])
+            else:
+                self.assertEqual(size_of(result), len(self.data))
+        results = self.app.run_modality_batch(MODALITY, [self.path] * 4)
+        self.assertEqual([size_of(r[PROVIDER]) for r in results],
+                         [len(self.data)] * 4)
+
+    def testSerialBatch(self):
+        # Waiting for the other evaluations must not count against the time
+        # limit of each one.
+        self.app.set_threads(8)
+        results = self.app.run_provider_batch("PySerial", [self.path] * 8)
+        self.assertEqual([r["errorCode"] for r in results], [0] * 8)
+        self.assertEqual([size_of(r) for r in results], [len(self.data)] * 8)
+
+    def testErrors(self):
+        self.assertNotEqual(
+            self.app.run_provider("NoSuchProvider", self.data)["errorCode"], 0)
+        with self.assertRaises(TypeError):
+            self.app.run_provider(PROVIDER, 5)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -53,6 +53,18 @@ DLL_EXPORT const char *provider_eval(const char *cFilePath)
     return Provider::serializeResult(result);
 }
 
+DLL_EXPORT const char *provider_eval_buffer(const char *cFilePath,
+                                            const unsigned char *data,
+                                            size_t length)
+{
+    // Override evaluateBuffer() to decode from memory; by default it reads
+    // the file again.
+    NewProvider p;
+    std::string filePath(cFilePath);
+    Provider::EvaluationResult result = p.evaluateBuffer(filePath, data, length);
+    return Provider::serializeResult(result);
+}
+
 DLL_EXPORT void provider_free(const char *result)
 {
     delete[] result;